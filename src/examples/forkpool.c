@@ -0,0 +1,84 @@
+/* forkpool.c
+
+   Worker pool built on fork().  The parent fills a table, then
+   forks N workers that each read the whole table and overwrite
+   their own slice of it.  With copy-on-write fork the workers
+   share the parent's pages and only copy the ones they write,
+   so a worker costs about its slice rather than the whole table.
+
+        pintos -- -q run 'forkpool 8'
+
+   Each worker checks that it sees the parent's data and not a
+   sibling's writes, and the parent checks that its own table is
+   untouched afterwards. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+
+/* Number of ints in the table. */
+#define TABLE_SIZE (256 * 1024)
+
+static int table[TABLE_SIZE];
+
+/* Worker ID of N: sums the table and overwrites its slice. */
+static int
+worker (int id, int n)
+{
+  int slice = TABLE_SIZE / n;
+  long long sum = 0;
+  int i;
+
+  for (i = 0; i < TABLE_SIZE; i++)
+    sum += table[i];
+  if (sum != (long long) TABLE_SIZE * (TABLE_SIZE - 1) / 2)
+    {
+      printf ("forkpool: worker %d: bad sum %lld\n", id, sum);
+      return 1;
+    }
+  for (i = id * slice; i < (id + 1) * slice; i++)
+    table[i] = -id;
+  return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  pid_t pids[64];
+  int n, i, failed = 0;
+
+  n = argc > 1 ? atoi (argv[1]) : 4;
+  if (n < 1 || n > 64)
+    {
+      printf ("usage: forkpool N, with 1 <= N <= 64\n");
+      return EXIT_FAILURE;
+    }
+
+  for (i = 0; i < TABLE_SIZE; i++)
+    table[i] = i;
+
+  for (i = 0; i < n; i++)
+    {
+      pids[i] = fork ();
+      if (pids[i] == 0)
+        return worker (i, n);
+      if (pids[i] == PID_ERROR)
+        {
+          printf ("forkpool: fork %d failed\n", i);
+          failed = 1;
+          n = i;
+          break;
+        }
+    }
+  for (i = 0; i < n; i++)
+    if (wait (pids[i]) != 0)
+      failed = 1;
+
+  for (i = 0; i < TABLE_SIZE; i++)
+    if (table[i] != i)
+      {
+        printf ("forkpool: parent's table changed at %d\n", i);
+        return EXIT_FAILURE;
+      }
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
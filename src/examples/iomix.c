@@ -0,0 +1,112 @@
+/* iomix.c
+
+   Mixed paging and file I/O benchmark.  Runs a paging-heavy
+   process, one pfscale child sweeping its buffer, alongside a
+   process that streams a file through a 64 kB buffer with read()
+   and write().  pfscale must be on the file system too.
+
+        pintos -- -q -ul=96 run 'iomix page'
+        pintos -- -q -ul=96 run 'iomix file'
+        pintos -- -q -ul=96 run 'iomix both'
+
+   Compare the "Timer: N ticks" line printed at shutdown: when
+   file I/O does not hold up paging (and the other way around),
+   "both" should take well under the sum of the other two. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Size of the streamed file and of each transfer, in bytes. */
+#define FILE_SIZE (512 * 1024)
+#define IO_SIZE (64 * 1024)
+
+/* Number of times the file is written and read back. */
+#define FILE_PASSES 4
+
+static char io_buf[IO_SIZE];
+
+/* Writes FILE_SIZE bytes to a scratch file and reads them back,
+   IO_SIZE bytes per system call. */
+static int
+streamer (void)
+{
+  int pass, fd;
+  size_t ofs, i;
+
+  if (!create ("iomix.dat", FILE_SIZE))
+    {
+      printf ("iomix: streamer: create failed\n");
+      return 1;
+    }
+  fd = open ("iomix.dat");
+  if (fd < 0)
+    {
+      printf ("iomix: streamer: open failed\n");
+      return 1;
+    }
+
+  for (pass = 0; pass < FILE_PASSES; pass++)
+    {
+      seek (fd, 0);
+      for (ofs = 0; ofs < FILE_SIZE; ofs += IO_SIZE)
+        {
+          memset (io_buf, (char) (pass + ofs / IO_SIZE), IO_SIZE);
+          if (write (fd, io_buf, IO_SIZE) != IO_SIZE)
+            {
+              printf ("iomix: streamer: short write\n");
+              return 1;
+            }
+        }
+      seek (fd, 0);
+      for (ofs = 0; ofs < FILE_SIZE; ofs += IO_SIZE)
+        {
+          if (read (fd, io_buf, IO_SIZE) != IO_SIZE)
+            {
+              printf ("iomix: streamer: short read\n");
+              return 1;
+            }
+          for (i = 0; i < IO_SIZE; i += 4096)
+            if (io_buf[i] != (char) (pass + ofs / IO_SIZE))
+              {
+                printf ("iomix: streamer: bad byte at %zu\n", ofs + i);
+                return 1;
+              }
+        }
+    }
+  close (fd);
+  remove ("iomix.dat");
+  return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  pid_t pager_pid = PID_ERROR, streamer_pid = PID_ERROR;
+  bool paging, streaming;
+  int failed = 0;
+
+  if (argc == 2 && !strcmp (argv[1], "-c"))
+    return streamer ();
+
+  paging = argc == 2 && (!strcmp (argv[1], "page") || !strcmp (argv[1], "both"));
+  streaming = argc == 2 && (!strcmp (argv[1], "file") || !strcmp (argv[1], "both"));
+  if (!paging && !streaming)
+    {
+      printf ("usage: iomix page|file|both\n");
+      return EXIT_FAILURE;
+    }
+
+  if (paging)
+    pager_pid = exec ("pfscale -c 0");
+  if (streaming)
+    streamer_pid = exec ("iomix -c");
+  if (paging && (pager_pid == PID_ERROR || wait (pager_pid) != 0))
+    failed++;
+  if (streaming && (streamer_pid == PID_ERROR || wait (streamer_pid) != 0))
+    failed++;
+
+  printf ("iomix: %s, %d failed\n", argv[1], failed);
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
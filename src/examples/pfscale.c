@@ -0,0 +1,79 @@
+/* pfscale.c
+
+   Page-fault scalability benchmark.  Starts N copies of itself
+   that each sweep a buffer larger than their share of user
+   memory, so every child keeps faulting and evicting while the
+   others do the same.
+
+   Run it with increasing N under a fixed user pool, e.g.
+
+        pintos -- -q -ul=256 run 'pfscale 1'
+        pintos -- -q -ul=256 run 'pfscale 8'
+
+   and compare the "Timer: N ticks" line printed at shutdown
+   divided by N: with parallel fault handling the time per child
+   should stay roughly flat instead of growing with N. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Size of each child's buffer, in bytes. */
+#define BUF_SIZE (512 * 1024)
+
+/* Number of times each child sweeps its buffer. */
+#define PASSES 4
+
+static char buf[BUF_SIZE];
+
+/* Child: dirties every page of BUF, then reads it back. */
+static int
+child (int id)
+{
+  size_t i;
+  int pass;
+
+  for (pass = 0; pass < PASSES; pass++)
+    {
+      for (i = 0; i < BUF_SIZE; i += 4096)
+        buf[i] = (char) (id + pass + i / 4096);
+      for (i = 0; i < BUF_SIZE; i += 4096)
+        if (buf[i] != (char) (id + pass + i / 4096))
+          {
+            printf ("pfscale: child %d: bad byte at %zu\n", id, i);
+            return 1;
+          }
+    }
+  return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  char cmd[32];
+  pid_t pids[64];
+  int n, i, failed = 0;
+
+  if (argc == 3 && !strcmp (argv[1], "-c"))
+    return child (atoi (argv[2]));
+
+  if (argc != 2 || (n = atoi (argv[1])) <= 0 || n > 64)
+    {
+      printf ("usage: pfscale <processes (1-64)>\n");
+      return EXIT_FAILURE;
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      snprintf (cmd, sizeof cmd, "pfscale -c %d", i);
+      pids[i] = exec (cmd);
+    }
+  for (i = 0; i < n; i++)
+    if (pids[i] == PID_ERROR || wait (pids[i]) != 0)
+      failed++;
+
+  printf ("pfscale: %d processes, %d page touches each, %d failed\n",
+          n, PASSES * BUF_SIZE / 4096, failed);
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
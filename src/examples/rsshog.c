@@ -0,0 +1,80 @@
+/* rsshog.c
+
+   Runs a process that keeps sweeping a buffer larger than user
+   memory next to a small process that keeps touching a working
+   set that fits easily, and reports how many major faults the
+   small one took after its first pass.
+
+        pintos -- -q -ul=256 run 'rsshog'
+        pintos -- -q -ul=256 -rss-hard=128 run 'rsshog'
+
+   With eviction going first to processes over their share of
+   memory, the small process should fault very little once its
+   working set is in. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Size of the hog's buffer, in bytes. */
+#define HOG_SIZE (2 * 1024 * 1024)
+
+/* Size of the small process's working set, in bytes. */
+#define SMALL_SIZE (64 * 1024)
+
+/* Number of passes each process makes over its buffer. */
+#define PASSES 8
+
+static char buf[HOG_SIZE];
+
+/* Dirties every page of the first SIZE bytes of BUF, PASSES times.
+   Returns the number of major faults after the first pass. */
+static long long
+sweep (size_t size)
+{
+  struct vmstat first, last;
+  size_t i;
+  int pass;
+
+  for (pass = 0; pass < PASSES; pass++)
+    {
+      if (pass == 1)
+        vmstat (&first, false);
+      for (i = 0; i < size; i += 4096)
+        buf[i] = (char) (pass + i / 4096);
+    }
+  vmstat (&last, false);
+  return last.major_faults - first.major_faults;
+}
+
+int
+main (int argc, char *argv[])
+{
+  pid_t hog, small;
+  long long faults;
+
+  if (argc == 2 && !strcmp (argv[1], "-hog"))
+    {
+      sweep (HOG_SIZE);
+      return EXIT_SUCCESS;
+    }
+  if (argc == 2 && !strcmp (argv[1], "-small"))
+    {
+      faults = sweep (SMALL_SIZE);
+      printf ("rsshog: small process: %lld major faults after warm-up\n",
+              faults);
+      return EXIT_SUCCESS;
+    }
+
+  hog = exec ("rsshog -hog");
+  small = exec ("rsshog -small");
+  if (hog == PID_ERROR || small == PID_ERROR)
+    {
+      printf ("rsshog: exec failed\n");
+      return EXIT_FAILURE;
+    }
+  wait (small);
+  wait (hog);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,77 @@
+/* vmstat.c
+
+   Runs a command and reports the system's paging counters
+   before and after, e.g.
+
+        pintos -- -q -ul=256 run 'vmstat pfscale 4'
+
+   With no command, just prints the counters so far. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+static void
+print_stats (const char *title, const struct vmstat *s)
+{
+  printf ("%s:\n", title);
+  printf ("  faults: %lld minor, %lld major, %lld stack\n",
+          s->minor_faults, s->major_faults, s->stack_faults);
+  printf ("  prefetched: %lld pages\n", s->prefetches);
+  printf ("  swap: %lld in, %lld out, %lld clean discards\n",
+          s->swap_ins, s->swap_outs, s->discards);
+  printf ("  zswap: %lld loads, %lld stores\n",
+          s->zswap_loads, s->zswap_stores);
+  printf ("  merging: %lld merge events\n", s->ksm_merge_events);
+  printf ("  eviction: %lld clock turns, %lld ticks\n",
+          s->clock_turns, s->swap_out_ticks);
+}
+
+int
+main (int argc, char *argv[])
+{
+  struct vmstat before, after, delta;
+  char cmd[128];
+  pid_t pid;
+  int i, status;
+
+  if (!vmstat (&before, true))
+    return EXIT_FAILURE;
+  if (argc < 2)
+    {
+      print_stats ("system", &before);
+      return EXIT_SUCCESS;
+    }
+
+  cmd[0] = '\0';
+  for (i = 1; i < argc; i++)
+    {
+      if (i > 1)
+        strlcat (cmd, " ", sizeof cmd);
+      strlcat (cmd, argv[i], sizeof cmd);
+    }
+  pid = exec (cmd);
+  if (pid == PID_ERROR)
+    {
+      printf ("vmstat: %s: exec failed\n", cmd);
+      return EXIT_FAILURE;
+    }
+  status = wait (pid);
+  vmstat (&after, true);
+
+  delta.minor_faults = after.minor_faults - before.minor_faults;
+  delta.major_faults = after.major_faults - before.major_faults;
+  delta.stack_faults = after.stack_faults - before.stack_faults;
+  delta.prefetches = after.prefetches - before.prefetches;
+  delta.swap_ins = after.swap_ins - before.swap_ins;
+  delta.swap_outs = after.swap_outs - before.swap_outs;
+  delta.zswap_loads = after.zswap_loads - before.zswap_loads;
+  delta.zswap_stores = after.zswap_stores - before.zswap_stores;
+  delta.ksm_merge_events = after.ksm_merge_events - before.ksm_merge_events;
+  delta.discards = after.discards - before.discards;
+  delta.clock_turns = after.clock_turns - before.clock_turns;
+  delta.swap_out_ticks = after.swap_out_ticks - before.swap_out_ticks;
+  print_stats (cmd, &delta);
+  return status;
+}
@@ -0,0 +1,181 @@
+#include "lz.h"
+#include <debug.h>
+#include <string.h>
+
+/* Returns the 4 bytes at P as an integer. */
+static inline uint32_t
+read32 (const uint8_t *p)
+{
+  uint32_t v;
+  memcpy (&v, p, sizeof v);
+  return v;
+}
+
+/* Returns the hash table index for the 4 bytes V. */
+static inline unsigned
+hash32 (uint32_t v)
+{
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Writes the part of LENGTH that did not fit in its token nibble
+   to OP, which may not pass OEND.  Returns the byte after the
+   last one written, or a null pointer if there is no room. */
+static uint8_t *
+put_length (uint8_t *op, uint8_t *oend, size_t length)
+{
+  for (; length >= 255; length -= 255)
+    {
+      if (op >= oend)
+        return NULL;
+      *op++ = 255;
+    }
+  if (op >= oend)
+    return NULL;
+  *op++ = length;
+  return op;
+}
+
+/* Writes a sequence of the LIT_CNT literal bytes at LIT followed,
+   unless MATCH_LEN is 0, by a match of MATCH_LEN bytes at OFFSET
+   bytes back, to OP, which may not pass OEND.  Returns the byte
+   after the sequence, or a null pointer if there is no room. */
+static uint8_t *
+put_sequence (uint8_t *op, uint8_t *oend, const uint8_t *lit, size_t lit_cnt,
+              size_t offset, size_t match_len)
+{
+  size_t match_code = match_len > 0 ? match_len - LZ_MIN_MATCH : 0;
+  uint8_t *token;
+
+  if (op >= oend)
+    return NULL;
+  token = op++;
+  *token = (lit_cnt < 15 ? lit_cnt : 15) << 4;
+  *token |= match_code < 15 ? match_code : 15;
+
+  if (lit_cnt >= 15 && (op = put_length (op, oend, lit_cnt - 15)) == NULL)
+    return NULL;
+  if ((size_t) (oend - op) < lit_cnt)
+    return NULL;
+  memcpy (op, lit, lit_cnt);
+  op += lit_cnt;
+
+  if (match_len == 0)
+    return op;
+  if (oend - op < 2)
+    return NULL;
+  *op++ = offset;
+  *op++ = offset >> 8;
+  if (match_code >= 15)
+    op = put_length (op, oend, match_code - 15);
+  return op;
+}
+
+/* Compresses the SRC_SIZE bytes at SRC into DST, which has room
+   for DST_SIZE bytes, using TABLE as scratch space.  Returns the
+   compressed size, or 0 if it would not fit in DST_SIZE bytes. */
+size_t
+lz_compress (const void *src_, size_t src_size,
+             void *dst_, size_t dst_size, uint16_t table[LZ_HASH_SIZE])
+{
+  const uint8_t *src = src_;
+  const uint8_t *ip = src;
+  const uint8_t *anchor = src;
+  const uint8_t *iend = src + src_size;
+  uint8_t *dst = dst_;
+  uint8_t *op = dst;
+  uint8_t *oend = dst + dst_size;
+
+  ASSERT (src_size <= LZ_MAX_INPUT);
+
+  memset (table, 0, LZ_HASH_SIZE * sizeof *table);
+  while (iend - ip >= LZ_MIN_MATCH)
+    {
+      uint32_t v = read32 (ip);
+      unsigned h = hash32 (v);
+      const uint8_t *ref = src + table[h];
+      size_t len;
+
+      table[h] = ip - src;
+      if (ref >= ip || read32 (ref) != v)
+        {
+          ip++;
+          continue;
+        }
+
+      for (len = LZ_MIN_MATCH; ip + len < iend && ref[len] == ip[len]; len++)
+        continue;
+      op = put_sequence (op, oend, anchor, ip - anchor, ip - ref, len);
+      if (op == NULL)
+        return 0;
+      ip += len;
+      anchor = ip;
+    }
+
+  op = put_sequence (op, oend, anchor, iend - anchor, 0, 0);
+  return op != NULL ? (size_t) (op - dst) : 0;
+}
+
+/* Reads a length extension from *IP, which may not pass IEND, and
+   adds it to *LENGTH.  Returns false if the input runs out. */
+static bool
+get_length (const uint8_t **ip, const uint8_t *iend, size_t *length)
+{
+  uint8_t b;
+
+  do
+    {
+      if (*ip >= iend)
+        return false;
+      b = *(*ip)++;
+      *length += b;
+    }
+  while (b == 255);
+  return true;
+}
+
+/* Decompresses the SRC_SIZE bytes at SRC into DST.  Returns true
+   if they expand to exactly DST_SIZE bytes, false if they do not
+   or are not valid compressed data. */
+bool
+lz_decompress (const void *src, size_t src_size, void *dst_, size_t dst_size)
+{
+  const uint8_t *ip = src;
+  const uint8_t *iend = ip + src_size;
+  uint8_t *dst = dst_;
+  uint8_t *op = dst;
+  uint8_t *oend = dst + dst_size;
+
+  while (ip < iend)
+    {
+      uint8_t token = *ip++;
+      size_t lit_cnt = token >> 4;
+      size_t match_len = (token & 15) + LZ_MIN_MATCH;
+      size_t offset;
+
+      if (lit_cnt == 15 && !get_length (&ip, iend, &lit_cnt))
+        return false;
+      if ((size_t) (iend - ip) < lit_cnt || (size_t) (oend - op) < lit_cnt)
+        return false;
+      memcpy (op, ip, lit_cnt);
+      ip += lit_cnt;
+      op += lit_cnt;
+      if (ip == iend)
+        break;
+
+      if (iend - ip < 2)
+        return false;
+      offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      if ((token & 15) == 15 && !get_length (&ip, iend, &match_len))
+        return false;
+      if (offset == 0 || offset > (size_t) (op - dst)
+          || (size_t) (oend - op) < match_len)
+        return false;
+
+      // the match may overlap the bytes it produces
+      for (; match_len > 0; match_len--, op++)
+        *op = op[-offset];
+    }
+  return op == oend;
+}
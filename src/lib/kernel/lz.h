@@ -0,0 +1,32 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+/* Fast LZ77 compression, in the style of LZ4.
+
+   The compressed form is a series of sequences.  Each sequence
+   is a token byte, whose high nibble is a count of literal bytes
+   and whose low nibble is a match length minus LZ_MIN_MATCH,
+   either nibble being extended by following bytes if it is 15;
+   then the literal bytes; then a 2-byte little-endian offset back
+   into the output, from which the match is copied.  The last
+   sequence has literals only.
+
+   The compressor finds matches with a single-entry hash table of
+   4-byte sequences, which the caller provides so that it need
+   not live on the kernel stack. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LZ_MIN_MATCH 4                  /* Shortest match encoded. */
+#define LZ_HASH_BITS 12
+#define LZ_HASH_SIZE (1 << LZ_HASH_BITS) /* Entries in the hash table. */
+#define LZ_MAX_INPUT 65535              /* Largest input, in bytes. */
+
+size_t lz_compress (const void *src, size_t src_size,
+                    void *dst, size_t dst_size, uint16_t table[LZ_HASH_SIZE]);
+bool lz_decompress (const void *src, size_t src_size,
+                    void *dst, size_t dst_size);
+
+#endif /* lib/kernel/lz.h */
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <vmstat.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -48,4 +49,8 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+pid_t fork (void);
+bool vmstat (struct vmstat *, bool global);
+
 #endif /* lib/user/syscall.h */
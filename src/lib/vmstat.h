@@ -0,0 +1,26 @@
+#ifndef __LIB_VMSTAT_H
+#define __LIB_VMSTAT_H
+
+/* Virtual memory counters, kept for each process and for the whole
+   system, and returned by the vmstat() system call.  A process is
+   charged for the events its own faults and system calls cause,
+   including the evictions done to make room for its pages. */
+struct vmstat
+  {
+    long long minor_faults;     /* Faults served without reading a disk. */
+    long long major_faults;     /* Faults that read from a file or swap. */
+    long long stack_faults;     /* Faults that grew the stack. */
+    long long swap_ins;         /* Pages read from the swap disk. */
+    long long swap_outs;        /* Pages written to the swap disk. */
+    long long zswap_loads;      /* Pages decompressed from the swap pool. */
+    long long zswap_stores;     /* Pages compressed into the swap pool. */
+    long long ksm_merge_events; /* Merges of a page into an identical one.
+                                   Not frames saved: a write or an exit
+                                   can unshare a merged page again. */
+    long long prefetches;       /* File pages mapped ahead of any fault. */
+    long long discards;         /* Clean pages evicted without a write. */
+    long long clock_turns;      /* Full revolutions of the clock hand. */
+    long long swap_out_ticks;   /* Timer ticks spent evicting for a fault. */
+  };
+
+#endif /* lib/vmstat.h */
@@ -0,0 +1,40 @@
+/* Forks, and has the child overwrite a data page and a stack page
+   it inherited.  The parent's copies must keep their old contents,
+   and wait() must return the child's exit code. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_EXIT 81
+
+static char data[4096] = "parent";
+
+void
+test_main (void)
+{
+  char stack[4096];
+  pid_t child;
+
+  memset (stack, 'p', sizeof stack);
+  child = fork ();
+  if (child == 0)
+    {
+      /* The child starts with the parent's contents. */
+      if (strcmp (data, "parent") || stack[0] != 'p'
+          || stack[sizeof stack - 1] != 'p')
+        exit (1);
+      strlcpy (data, "child", sizeof data);
+      memset (stack, 'c', sizeof stack);
+      exit (CHILD_EXIT);
+    }
+
+  CHECK (child > 0, "fork");
+  CHECK (wait (child) == CHILD_EXIT, "wait for child");
+  if (strcmp (data, "parent"))
+    fail ("child's write to data page visible to parent");
+  if (stack[0] != 'p' || stack[sizeof stack - 1] != 'p')
+    fail ("child's write to stack page visible to parent");
+  msg ("parent's pages unchanged");
+}
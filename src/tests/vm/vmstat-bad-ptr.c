@@ -0,0 +1,13 @@
+/* Passes an invalid pointer to the vmstat system call.
+   The process must be terminated with -1 exit code. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  vmstat ((struct vmstat *) 0xc0100000, false);
+  fail ("should not have survived vmstat()");
+}
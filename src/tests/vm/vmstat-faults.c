@@ -0,0 +1,35 @@
+/* Writes to a known number of untouched pages and checks that the
+   process's fault counters went up by at least that much, and that
+   the system-wide counters are no smaller than the process's. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_CNT 16
+
+static char buf[PAGE_CNT * 4096];
+
+void
+test_main (void)
+{
+  struct vmstat before, after, global;
+  long long faults;
+  size_t i;
+
+  CHECK (vmstat (&before, false), "vmstat before");
+  for (i = 0; i < sizeof buf; i += 4096)
+    buf[i] = 1;
+  CHECK (vmstat (&after, false), "vmstat after");
+  CHECK (vmstat (&global, true), "vmstat global");
+
+  faults = (after.minor_faults + after.major_faults)
+           - (before.minor_faults + before.major_faults);
+  if (faults < PAGE_CNT)
+    fail ("%lld faults for %d new pages", faults, PAGE_CNT);
+  msg ("fault counters went up");
+  if (global.minor_faults < after.minor_faults
+      || global.major_faults < after.major_faults)
+    fail ("global counters smaller than the process's");
+  msg ("global counters cover the process's");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(vmstat-faults) begin
+(vmstat-faults) vmstat before
+(vmstat-faults) vmstat after
+(vmstat-faults) vmstat global
+(vmstat-faults) fault counters went up
+(vmstat-faults) global counters cover the process's
+(vmstat-faults) end
+vmstat-faults: exit(0)
+EOF
+pass;
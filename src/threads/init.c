@@ -38,28 +38,73 @@
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
+#ifdef VM
+#include "vm/evict.h"
+#include "vm/frame.h"
+#include "vm/ksm.h"
+#include "vm/page.h"
+#include "vm/prepage.h"
+#include "vm/share.h"
+#include "vm/swap.h"
+#endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
 
+#define CR4_PSE 0x00000010      /* Page Size Extensions (4 MB pages). */
+#define CR4_PGE 0x00000080      /* Page Global Enable. */
+#define CPUID_PSE 0x00000008    /* CPUID 1, EDX: 4 MB pages supported. */
+#define CPUID_PGE 0x00002000    /* CPUID 1, EDX: global pages supported. */
+
 #ifdef FILESYS
 /* -f: Format the file system? */
 static bool format_filesys;
 
 /* -filesys, -scratch, -swap: Names of block devices to use,
-   overriding the defaults. */
+   overriding the defaults.  -swap takes a comma-separated list. */
 static const char *filesys_bdev_name;
 static const char *scratch_bdev_name;
 #ifdef VM
-static const char *swap_bdev_name;
+static char *swap_bdev_names;
 #endif
 #endif /* FILESYS */
 
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+#ifdef VM
+/* -lowat, -hiwat: Free user pages below which the page cleaner
+   wakes up, and at which it goes back to sleep. */
+static size_t low_watermark = 4;
+static size_t high_watermark = 16;
+
+/* -evict: Page replacement policy. */
+static const char *evict_policy_name;
+
+/* -rss-soft, -rss-hard: Resident set limits per process, in pages.
+   0 means a fair share of memory for the soft limit and no hard
+   limit. */
+static size_t rss_soft_limit;
+static size_t rss_hard_limit;
+
+/* -zswap: Pages of kernel memory for compressed swap, 0 for none. */
+static size_t zswap_pages = 32;
+
+/* -fault-around: Pages mapped around a fault on a file-backed
+   page, 1 for just the faulting page. */
+static size_t fault_around_pages = 8;
+
+/* -prepage: Ticks of start-up faults to record for each program,
+   and prefetch on later runs, 0 for none. */
+static int prepage_ticks;
+
+/* -ksm: Merge identical pages of different processes. */
+static bool ksm_enabled;
+#endif
+
 static void bss_init (void);
 static void paging_init (void);
+static uint32_t cpu_features (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
@@ -127,8 +172,16 @@ pintos_init (void)
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
-  swap_init ();
+#ifdef VM
   frame_init ();
+  share_init ();
+  page_init (fault_around_pages);
+  prepage_init (prepage_ticks);
+  evict_init (evict_policy_name, rss_soft_limit, rss_hard_limit);
+  swap_init (swap_bdev_names, low_watermark, high_watermark, zswap_pages);
+  if (ksm_enabled)
+    ksm_init ();
+#endif
 
   printf ("Boot complete.\n");
 
@@ -160,13 +213,23 @@ bss_init (void)
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   Where the CPU supports it, each whole, aligned 4 MB of RAM is
+   mapped with a single large page instead of a page table, so
+   that a handful of TLB entries cover the kernel's view of all
+   of memory.  The 4 MB holding the kernel's text keeps small
+   pages so that the text can stay read-only. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
   extern char _start, _end_kernel_text;
+  uint32_t features = cpu_features ();
+  uint32_t global = features & CPUID_PGE ? PTE_G : 0;
+  bool large = (features & CPUID_PSE) != 0;
+  uint32_t cr4;
 
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
@@ -178,15 +241,35 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (large && pte_idx == 0 && page + PTSPAN / PGSIZE <= init_ram_pages
+          && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text))
+        {
+          pd[pde_idx] = pde_create_large (vaddr, true) | global;
+          page += PTSPAN / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | global;
     }
 
+  /* Large pages must be enabled before the CPU sees them.  The
+     kernel's mappings are the same in every page directory, so
+     with global pages enabled switching address spaces keeps
+     them in the TLB.  See [IA32-v3a] 3.6.1 "Paging Options" and
+     3.12 "Translation Lookaside Buffers (TLBs)". */
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  if (large)
+    cr4 |= CR4_PSE;
+  if (global)
+    cr4 |= CR4_PGE;
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4) : "memory");
+
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
@@ -195,6 +278,17 @@ paging_init (void)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
 }
 
+/* Returns the CPU's feature flags, from CPUID.  See [IA32-v2a]
+   "CPUID--CPU Identification". */
+static uint32_t
+cpu_features (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return edx;
+}
+
 /* Breaks the kernel command line into words and returns them as
    an argv-like array. */
 static char **
@@ -256,7 +350,7 @@ parse_options (char **argv)
         scratch_bdev_name = value;
 #ifdef VM
       else if (!strcmp (name, "-swap"))
-        swap_bdev_name = value;
+        swap_bdev_names = value;
 #endif
 #endif
       else if (!strcmp (name, "-rs"))
@@ -266,6 +360,26 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-lowat"))
+        low_watermark = atoi (value);
+      else if (!strcmp (name, "-hiwat"))
+        high_watermark = atoi (value);
+      else if (!strcmp (name, "-evict"))
+        evict_policy_name = value;
+      else if (!strcmp (name, "-rss-soft"))
+        rss_soft_limit = atoi (value);
+      else if (!strcmp (name, "-rss-hard"))
+        rss_hard_limit = atoi (value);
+      else if (!strcmp (name, "-zswap"))
+        zswap_pages = atoi (value);
+      else if (!strcmp (name, "-fault-around"))
+        fault_around_pages = atoi (value);
+      else if (!strcmp (name, "-prepage"))
+        prepage_ticks = atoi (value);
+      else if (!strcmp (name, "-ksm"))
+        ksm_enabled = true;
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -382,13 +496,32 @@ usage (void)
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
 #ifdef VM
-          "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+          "  -swap=BDEV,...     Swap to the listed devices instead of to every\n"
+          "                     swap device.  BDEV:PRI sets a priority: higher\n"
+          "                     ones fill first, equal ones are striped.\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -lowat=COUNT       Start cleaning pages below COUNT free frames.\n"
+          "  -hiwat=COUNT       Stop cleaning pages at COUNT free frames.\n"
+          "  -evict=POLICY      Replace pages with POLICY: clock (default),\n"
+          "                     aging, wsclock or arc.\n"
+          "  -rss-soft=COUNT    Evict first from processes over COUNT pages\n"
+          "                     (default: an equal share of user memory).\n"
+          "  -rss-hard=COUNT    Keep each process to COUNT resident pages.\n"
+          "  -zswap=COUNT       Compress swapped pages into COUNT pages of RAM\n"
+          "                     before using the swap disk (default: 32).\n"
+          "  -fault-around=COUNT  Map up to COUNT file pages around each fault\n"
+          "                     on one (default: 8, 1 for none).\n"
+          "  -prepage=TICKS     Record the pages each program faults in during\n"
+          "                     its first TICKS ticks, and load them up front\n"
+          "                     on later runs.\n"
+          "  -ksm               Merge identical pages of different processes.\n"
 #endif
           );
   shutdown_power_off ();
@@ -401,9 +534,7 @@ locate_block_devices (void)
 {
   locate_block_device (BLOCK_FILESYS, filesys_bdev_name);
   locate_block_device (BLOCK_SCRATCH, scratch_bdev_name);
-#ifdef VM
-  locate_block_device (BLOCK_SWAP, swap_bdev_name);
-#endif
+  // swap_init() finds the swap devices, since there can be several
 }
 
 /* Figures out what block device to use for the given ROLE: the
@@ -65,12 +65,9 @@ palloc_init (size_t user_page_limit)
   init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
              user_pages, "user pool");
 
-  // allocate the frame table
-  // TODO: do we need to free this at some point?
-  user_pgs = user_pages;
-  frame_table = malloc(sizeof(struct frame_entry) * user_pages);
-
-  lock_init (&alloc_lock);
+  // the frame table itself is allocated in frame_init(). the pool is
+  // smaller than user_pages by the pages its bitmap takes
+  user_pgs = bitmap_size (user_pool.used_map);
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
@@ -158,12 +155,12 @@ void
 palloc_free_page (void *page)
 {
   // page is a kernel virtual address
-  // get its PFN so that we can free its frame table entry
-  uintptr_t phys_ptr = vtop (page);
-  int pfn = pg_no (phys_ptr);
-  if ((pfn-625) > 0)
+  // the frame table owns the whole user pool once it is set up, so
+  // user frames go back on its free list
+  if (page_from_pool (&user_pool, page) && frame_table != NULL)
   {
-    free (frame_table[pfn-625]);
+    frame_free (page);
+    return;
   }
 
   palloc_free_multiple (page, 1);
@@ -15,6 +15,8 @@
 #include "threads/vaddr.h"
 #include "vm/swap.h"
 #include "vm/frame.h"
+#include "vm/evict.h"
+#include "vm/region.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -144,6 +146,11 @@ thread_tick (void)
   else
     kernel_ticks++;
 
+#ifdef VM
+  /* Let the page replacement policy sample accessed bits. */
+  evict_tick ();
+#endif
+
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
@@ -198,6 +205,9 @@ thread_create (const char *name, int priority,
   t->element->exit_status = 0;
   t->element->thread = t;
   t->stack_pages = 0;
+  t->syscall_esp = NULL;
+  t->rss = 0;
+  t->prepage = NULL;
 
   lock_init (&t->element->lock);
   list_push_back (&thread_list, &e->elem);
@@ -339,9 +349,10 @@ thread_exit (void)
       struct swap_table_elem* entry = list_entry (e, struct swap_table_elem, elem);
       // set all of the swap slots that this thread used to available
       // so that other processes may use them
-      bitmap_set (swap_slots, entry->swap_location, 0);
+      swap_free_slot (entry->swap_location);
       free(entry);
     }
+  swap_release_cluster ();
 
   // destroy the supplemental page table
   // the pages associated with this thread's process are freed when we call
@@ -349,6 +360,7 @@ thread_exit (void)
   lock_acquire (&cur->spt_lock);
   hash_destroy (&cur->s_page_table, destroy_hash);
   lock_release (&cur->spt_lock);
+  region_destroy ();
 
   list_remove (&cur->allelem);
   lock_acquire(&cur->element->lock);
@@ -465,6 +477,18 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+#ifdef VM
+      /* Nobody else wants to run, so zero free user frames ahead
+         of the zero-fill faults that will want them, one at a time
+         so that a thread that becomes ready doesn't wait long. */
+      intr_enable ();
+      while (list_empty (&ready_list) && frame_zero_idle ())
+        continue;
+      intr_disable ();
+      if (!list_empty (&ready_list))
+        continue;
+#endif
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -538,6 +562,9 @@ init_thread (struct thread *t, const char *name, int priority)
   sema_init (&t->exec_sema, 0);
   list_init (&t->locks);
   list_init (&t->fd_list);
+  list_init (&t->regions);
+  list_init (&t->mmap_list);
+  t->next_mapid = 1;
 
   old_level = intr_disable ();
   list_push_back (&all_list, &t->allelem);
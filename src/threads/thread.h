@@ -5,6 +5,7 @@
 #include <list.h>
 #include <stdint.h>
 #include <hash.h>
+#include <vmstat.h>
 #include "synch.h"
 #include "vm/page.h"
 
@@ -117,8 +118,18 @@ struct thread
     struct hash s_page_table;
     struct lock spt_lock;
     int stack_pages;
+    void* syscall_esp;                  /* User stack pointer at the last system call. */
+    int rss;                            /* Resident private pages, protected by frame_lock. */
+    struct prepage_log* prepage;        /* Startup faults being recorded, see vm/prepage.h. */
+    struct vmstat vmstat;               /* Paging counters, see vm/vmstat.h. */
 
     struct list swap_table;
+    struct list regions;                /* Address space regions, see vm/region.h. */
+    struct list mmap_list;              /* File mappings, see vm/mmap.h. */
+    int next_mapid;                     /* Id of the next mapping. */
+    struct file* exec_file;             /* Executable, open for demand paging. */
+    size_t swap_cluster;                /* Next slot in this process's swap cluster. */
+    size_t swap_cluster_end;            /* End of that cluster. */
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
@@ -160,20 +160,43 @@ page_fault (struct intr_frame *f)
 
   if (not_present)
   {
-    // if the fault address is close to the stack, we need to grow the stack
-    if ((int)f->esp - (int)fault_addr <= 32 && (int)f->esp - (int)fault_addr > -131072 && (int)f->esp - (int)fault_addr != 0)
+    // a kernel fault on a user page comes from a system call, so the
+    // stack to grow is the one the process had when it made the call
+    void* esp = user ? f->esp : thread_current ()->syscall_esp;
+
+    // if the fault address is close to the stack and isn't a stack page
+    // we already own (possibly swapped out), we need to grow the stack
+    if ((int)esp - (int)fault_addr <= 32 && (int)esp - (int)fault_addr > -131072 && (int)esp - (int)fault_addr != 0
+        && is_user_vaddr (fault_addr) && !page_in_spt (fault_addr))
     {
       add_stack_page (f, fault_addr);
       return;
     }
     // otherwise, we add a page from the supplemental page table
-    // this includes situations where we need to swap in
-    else {
+    // this includes situations where we need to swap in. a bad address
+    // kills a user process; the kernel gets to recover below
+    else if (user || page_in_spt (fault_addr))
+    {
       add_spt_page (f, fault_addr);
       return;
     }
   }
 
+  // a write to a page that fork() left shared gets its own copy. this
+  // also happens when the kernel writes to a user buffer
+  else if (write && is_user_vaddr (fault_addr) && page_write_fault (fault_addr))
+    return;
+
+  // the kernel only touches user memory it hasn't validated through
+  // get_user() and put_user() in userprog/syscall.c, which leave the
+  // address to resume at in EAX and expect -1 there on failure
+  if (!user && is_user_vaddr (fault_addr))
+  {
+    f->eip = (void (*) (void)) f->eax;
+    f->eax = 0xffffffff;
+    return;
+  }
+
   /* To implement virtual memory, delete the rest of the function
      body, and replace it with code that brings in the page to
      which fault_addr refers. */
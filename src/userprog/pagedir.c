@@ -3,11 +3,12 @@
 #include <stddef.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 
 static uint32_t *active_pd (void);
-static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -80,6 +81,11 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
         return NULL;
     }
 
+  /* The kernel's direct map may use large pages, which have no
+     page table entry of their own. */
+  if (*pde & PTE_PS)
+    return NULL;
+
   /* Return the page table entry. */
   pt = pde_get_pt (*pde);
   return &pt[pt_no (vaddr)];
@@ -152,10 +158,20 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
     }
 }
 
+/* Returns true if the PTE for virtual page VPAGE in PD allows
+   writes.
+   Returns false if PD contains no PTE for VPAGE. */
+bool
+pagedir_is_writable (uint32_t *pd, const void *vpage)
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  return pte != NULL && (*pte & PTE_W) != 0;
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
    that is, if the page has been modified since the PTE was
    installed.
@@ -180,7 +196,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -209,11 +225,80 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else
         {
           *pte &= ~(uint32_t) PTE_A;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
 
+/* Accessed bits cleared by pagedir_test_and_clear_accessed() whose
+   TLB entries haven't been invalidated yet. Past DEFERRED_MAX of them
+   the whole TLB is flushed instead. Protected by disabling interrupts,
+   since the aging policy clears bits from the timer interrupt. */
+#define DEFERRED_MAX 32
+static struct
+  {
+    uint32_t *pd;
+    const void *vpage;
+  }
+deferred[DEFERRED_MAX];
+static int deferred_cnt;
+static bool deferred_overflow;
+
+/* Returns the accessed bit of the PTE for virtual page VPAGE in PD and
+   clears it, like pagedir_is_accessed() followed by
+   pagedir_set_accessed(), but leaves invalidating the TLB entry to
+   the next pagedir_flush_deferred(). Until then the CPU may use the
+   page without setting the bit again, which only makes the page look
+   a little older than it is, so a sweep over many pages can pay for
+   one flush instead of one per page. */
+bool
+pagedir_test_and_clear_accessed (uint32_t *pd, const void *vpage)
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  enum intr_level old_level;
+
+  if (pte == NULL || (*pte & PTE_A) == 0)
+    return false;
+  *pte &= ~(uint32_t) PTE_A;
+
+  // only the active page directory can have entries in the TLB
+  if (active_pd () == pd)
+    {
+      old_level = intr_disable ();
+      if (deferred_cnt < DEFERRED_MAX)
+        {
+          deferred[deferred_cnt].pd = pd;
+          deferred[deferred_cnt].vpage = vpage;
+          deferred_cnt++;
+        }
+      else
+        deferred_overflow = true;
+      intr_set_level (old_level);
+    }
+  return true;
+}
+
+/* Invalidates the TLB entries left stale by
+   pagedir_test_and_clear_accessed(). */
+void
+pagedir_flush_deferred (void)
+{
+  enum intr_level old_level = intr_disable ();
+  uint32_t *pd = active_pd ();
+  int i;
+
+  // a page directory that was switched away from since has already
+  // lost its TLB entries
+  if (deferred_overflow)
+    pagedir_activate (pd);
+  else
+    for (i = 0; i < deferred_cnt; i++)
+      invalidate_page (deferred[i].pd, deferred[i].vpage);
+  deferred_cnt = 0;
+  deferred_overflow = false;
+  intr_set_level (old_level);
+}
+
 /* Loads page directory PD into the CPU's page directory base
    register. */
 void
@@ -230,6 +315,21 @@ pagedir_activate (uint32_t *pd)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
 }
 
+/* Makes PD the active page directory for a thread being switched
+   to, without reloading CR3 if it already is, so that the TLB keeps
+   its user entries too.  A null PD, a kernel thread's, keeps
+   whatever page directory is active: the kernel's mappings are the
+   same in all of them, so kernel threads and the idle thread can run
+   on the last process's without flushing it.  The borrowed page
+   directory can't be freed under them, because a process activates
+   the base page directory before it destroys its own. */
+void
+pagedir_switch (uint32_t *pd)
+{
+  if (pd != NULL && pd != active_pd ())
+    pagedir_activate (pd);
+}
+
 /* Returns the currently active page directory. */
 static uint32_t *
 active_pd (void)
@@ -243,21 +343,20 @@ active_pd (void)
   return ptov (pd);
 }
 
-/* Seom page table changes can cause the CPU's translation
+/* Some page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
-   table.  When this happens, we have to "invalidate" the TLB by
-   re-activating it.
+   table.  When this happens, we have to "invalidate" the TLB
+   entry for the page that changed.
 
-   This function invalidates the TLB if PD is the active page
-   directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+   This function invalidates the TLB entry for VPAGE if PD is the
+   active page directory.  (If PD is not active then its entries
+   are not in the TLB, so there is no need to invalidate
+   anything.)  Unlike re-activating PD, this leaves the rest of
+   the TLB alone.  See [IA32-v3a] 3.12 "Translation Lookaside
+   Buffers (TLBs)". */
 static void
-invalidate_pagedir (uint32_t *pd)
+invalidate_page (uint32_t *pd, const void *vpage)
 {
   if (active_pd () == pd)
-    {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-         "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
-    }
+    asm volatile ("invlpg (%0)" : : "r" (vpage) : "memory");
 }
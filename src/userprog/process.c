@@ -18,12 +18,17 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "vm/frame.h"
+#include "vm/mmap.h"
+#include "vm/prepage.h"
+#include "vm/region.h"
 
 static thread_func start_process NO_RETURN;
+static thread_func start_fork NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
 
 /* Starts a new thread running a user program loaded from
@@ -126,6 +131,116 @@ start_process (void *file_name_)
   NOT_REACHED ();
 }
 
+/* What a forking process hands to its child. Lives on the parent's
+   stack, which stays put because the parent waits on its exec_sema
+   until the child is done with it. */
+struct fork_args
+  {
+    struct thread *parent;
+    struct intr_frame *f;       /* Parent's user context at the fork() call. */
+    bool success;
+  };
+
+/* Creates a child process that is a copy of the current one and
+   continues from the system call whose frame is F, with fork()
+   returning 0. The child's memory is shared copy-on-write with ours,
+   so nothing is copied until one of us writes to it. Returns the
+   child's thread id, or TID_ERROR. */
+tid_t
+process_fork (struct intr_frame *f)
+{
+  struct thread *cur = thread_current ();
+  struct fork_args args;
+  tid_t tid;
+
+  args.parent = cur;
+  args.f = f;
+  args.success = false;
+  tid = thread_create (cur->name, PRI_DEFAULT, start_fork, &args);
+  if (tid == TID_ERROR)
+    return tid;
+  // the child copies our address space while we wait, so it can't
+  // change under it
+  sema_down (&cur->exec_sema);
+  return args.success ? tid : TID_ERROR;
+}
+
+/* Gives the current thread copies of PARENT's open files, at the same
+   positions and with the same descriptors. */
+static bool
+copy_fds (struct thread *parent)
+{
+  struct thread *cur = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&parent->fd_list); e != list_end (&parent->fd_list);
+       e = list_next (e))
+    {
+      struct fd_elem *entry = list_entry (e, struct fd_elem, elem);
+      struct fd_elem *copy = malloc (sizeof *copy);
+      if (copy == NULL)
+        return false;
+      copy->fd = entry->fd;
+      copy->file = file_reopen (entry->file);
+      if (copy->file == NULL)
+        {
+          free (copy);
+          return false;
+        }
+      file_seek (copy->file, file_tell (entry->file));
+      list_push_back (&cur->fd_list, &copy->elem);
+      cur->num_file++;
+    }
+  cur->next_fd = parent->next_fd;
+  return true;
+}
+
+/* A thread function that makes the new thread a copy of the process
+   that forked it and starts it running. */
+static void
+start_fork (void *args_)
+{
+  struct fork_args *args = args_;
+  struct thread *parent = args->parent;
+  struct thread *cur = thread_current ();
+  struct intr_frame if_ = *args->f;
+  bool success = false;
+
+  cur->pagedir = pagedir_create ();
+  if (cur->pagedir != NULL)
+    {
+      process_activate ();
+      cur->stack_pages = parent->stack_pages;
+
+      lock_acquire (&file_lock);
+      cur->exec_file = file_reopen (parent->exec_file);
+      if (cur->exec_file != NULL)
+        {
+          file_deny_write (cur->exec_file);
+          success = copy_fds (parent);
+        }
+      lock_release (&file_lock);
+
+      success = success && page_fork (parent, cur->exec_file);
+    }
+
+  args->success = success;
+  if (!success)
+    {
+      lock_acquire (&cur->element->lock);
+      cur->element->exit_status = -1;
+      lock_release (&cur->element->lock);
+      sema_up (&parent->exec_sema);
+      thread_exit ();
+    }
+  sema_up (&parent->exec_sema);
+
+  /* fork() returns 0 in the child. */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -212,6 +327,14 @@ process_exit (void)
   pd = cur->pagedir;
   if (pd != NULL)
     {
+      /* Write back mapped files while their pages are still here. */
+      mmap_unmap_all ();
+
+      /* Take our pages out of the frame table first, so that no
+         other thread tries to evict them from a page directory
+         that is about to disappear. */
+      page_release_frames (cur);
+
       /* Correct ordering here is crucial.  We must set
          cur->pagedir to NULL before switching page directories,
          so that a timer interrupt can't switch back to the
@@ -223,6 +346,20 @@ process_exit (void)
       pagedir_activate (NULL);
       pagedir_destroy (pd);
     }
+
+  /* Nothing can fault on the executable any more. */
+  if (cur->exec_file != NULL)
+    {
+      /* We may be dying in the middle of a file system call. */
+      bool acquired_lock = !lock_held_by_current_thread (&file_lock);
+      if (acquired_lock)
+        lock_acquire (&file_lock);
+      prepage_exit ();
+      file_close (cur->exec_file);
+      if (acquired_lock)
+        lock_release (&file_lock);
+      cur->exec_file = NULL;
+    }
 }
 
 /* Sets up the CPU for running user code in the current
@@ -233,8 +370,8 @@ process_activate (void)
 {
   struct thread *t = thread_current ();
 
-  /* Activate thread's page tables. */
-  pagedir_activate (t->pagedir);
+  /* Activate thread's page tables, if it has its own. */
+  pagedir_switch (t->pagedir);
 
   /* Set thread's kernel stack for use in processing
      interrupts. */
@@ -308,7 +445,7 @@ static bool setup_stack (void **esp, char *file_name);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
-                          bool writable, char** name);
+                          bool writable);
 
 /* Loads an ELF executable from FILE_NAME into the current thread.
    Stores the executable's entry point into *EIP
@@ -338,10 +475,6 @@ load (const char *file_name, void (**eip) (void), void **esp)
   strlcpy (copy, file_name, PGSIZE);
   char* fn = strtok_r(copy, " ", &save_ptr);
 
-  // save the file name for use later
-  char** name = malloc(sizeof(fn));
-  strlcpy (name, fn, strlen(fn)+1);
-
   /* Open executable file. */
   file = filesys_open (fn);
   palloc_free_page(copy); // free page to prevent memory leak
@@ -414,7 +547,7 @@ load (const char *file_name, void (**eip) (void), void **esp)
                   zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
                 }
               if (!load_segment (file, file_page, (void *) mem_page,
-                                 read_bytes, zero_bytes, writable, name))
+                                 read_bytes, zero_bytes, writable))
                 goto done;
             }
           else
@@ -431,9 +564,19 @@ load (const char *file_name, void (**eip) (void), void **esp)
   *eip = (void (*) (void)) ehdr.e_entry;
   success = true;
 
+  /* Keep the executable open, and unwritable, for as long as the
+     process runs: its pages are demand-loaded straight from this
+     handle. process_exit() closes it. */
+  file_deny_write (file);
+  t->exec_file = file;
+
+  /* Bring in the pages the program usually starts with. */
+  prepage_exec (file);
+
  done:
   /* We arrive here whether the load is successful or not. */
-  file_close (file);
+  if (!success)
+    file_close (file);
   return success;
 }
 
@@ -502,50 +645,16 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    or disk read error occurs. */
 static bool
 load_segment (struct file *file, off_t ofs, uint8_t *upage,
-              uint32_t read_bytes, uint32_t zero_bytes, bool writable, char** name)
+              uint32_t read_bytes, uint32_t zero_bytes, bool writable)
 {
   ASSERT ((read_bytes + zero_bytes) % PGSIZE == 0);
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
-  file_seek (file, ofs);
-  int pos = 0;
-  while (read_bytes > 0 || zero_bytes > 0)
-    {
-
-      /* Calculate how to fill this page.
-         We will read PAGE_READ_BYTES bytes from FILE
-         and zero the final PAGE_ZERO_BYTES bytes. */
-      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-      size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-      // put this page into the page table
-      struct thread* t = thread_current();
-
-      struct page_table_elem* entry = malloc(sizeof(struct page_table_elem));
-      entry->t = t;
-      entry->addr = upage;
-      entry->ofs = ofs;
-      entry->page_read_bytes = page_read_bytes;
-      entry->page_zero_bytes = page_zero_bytes;
-      entry->page_no = pg_no(upage);
-      entry->name = name;
-      entry->writable = writable;
-      entry->pos = pos;
-      entry->swapped = false;
-
-      lock_acquire (&t->spt_lock);
-      struct hash_elem* h = hash_insert (&t->s_page_table, &entry->elem);
-      lock_release (&t->spt_lock);
-
-      /* Advance. */
-      read_bytes -= page_read_bytes;
-      pos += page_read_bytes;
-      zero_bytes -= page_zero_bytes;
-      upage += PGSIZE;
-    }
-
-  return true;
+  /* Nothing is read or allocated per page here: the segment becomes
+     one region, and its pages are brought in as they are touched. */
+  return region_add (upage, (read_bytes + zero_bytes) / PGSIZE, file, ofs,
+                     read_bytes, writable, false) != NULL;
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
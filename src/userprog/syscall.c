@@ -1,5 +1,6 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
@@ -11,26 +12,38 @@
 #include "threads/synch.h"
 #include "process.h"
 #include "threads/palloc.h"
+#include "vm/mmap.h"
 #include "vm/page.h"
 #include "vm/swap.h"
+#include "vm/vmstat.h"
 
 static void syscall_handler (struct intr_frame *);
 void sys_exit (int status);
 static tid_t sys_exec (const char* file);
 static void sys_halt ();
+static tid_t sys_fork (struct intr_frame *f);
+static bool sys_vmstat (struct vmstat *stats, bool global);
+static int sys_mmap (int fd, void* addr);
+static void sys_munmap (int mapid);
 static bool sys_create (const char* file, unsigned size);
 int sys_wait (tid_t pid);
 int sys_open (const char* file);
 void sys_close (int fd);
 int sys_filesize (int fd);
-int sys_read (int fd, const void *buffer, unsigned size);
+int sys_read (int fd, void *buffer, unsigned size);
 int sys_write (int fd, const void *buffer, unsigned size);
 bool sys_remove (const char *file);
 void sys_seek (int fd, unsigned position);
 unsigned sys_tell (int fd);
-void check_address (void* addr, struct intr_frame *f);
 void release_locks (void);
-void check_page (void* addr);
+static bool user_range_ok (const void* uaddr, size_t size);
+static void pin_buffer (const void* uaddr, size_t size, bool write);
+static void unpin_buffer (const void* uaddr, size_t size);
+
+/* Largest part of a user buffer that read() and write() pin at once,
+   in bytes. Pinning all of a large buffer could leave the evictor with
+   nothing to evict. */
+#define PIN_CHUNK (16 * PGSIZE)
 
 void
 syscall_init (void)
@@ -59,6 +72,41 @@ static tid_t sys_exec (const char* file)
   return ret_pid;
 }
 
+/* SYS_MMAP */
+static int sys_mmap (int fd, void* addr)
+{
+  return mmap_map (fd, addr);
+}
+
+/* SYS_MUNMAP */
+static void sys_munmap (int mapid)
+{
+  mmap_unmap (mapid);
+}
+
+/* SYS_FORK */
+static tid_t sys_fork (struct intr_frame *f)
+{
+  return process_fork (f);
+}
+
+/* SYS_VMSTAT */
+static bool sys_vmstat (struct vmstat *stats, bool global)
+{
+  struct vmstat copy;
+  enum intr_level old_level;
+
+  // take a consistent snapshot: the counters are updated with
+  // interrupts off
+  old_level = intr_disable ();
+  copy = global ? vmstat_global : thread_current ()->vmstat;
+  intr_set_level (old_level);
+
+  if (!copy_to_user (stats, &copy, sizeof copy))
+    sys_exit (-1);
+  return true;
+}
+
 /* SYS_HALT */
 static void sys_halt()
 {
@@ -97,11 +145,9 @@ int sys_open (const char* file)
   int fd = -1;
   struct file *file_ptr = NULL;
 
-  lock_acquire(&swap_lock);
   lock_acquire(&file_lock);
   file_ptr = filesys_open(file);
   lock_release(&file_lock);
-  lock_release(&swap_lock);
   if (file_ptr != NULL) {
     /* add file to this thread's fd_list */
     struct thread *t = thread_current();
@@ -170,49 +216,84 @@ sys_filesize (int fd)
 }
 
 
-int sys_read (int fd, const void *buffer, unsigned size)
+/* Returns the current thread's open file with descriptor FD, or NULL
+   if there is none. */
+static struct file*
+fd_file (int fd)
 {
-  /* read in file according to input type */
-  int ret = -1;
+  struct list_elem *e;
+  struct thread *t = thread_current();
 
-  /* STDIN */
-  if (fd == 0){
-    for (uint32_t i = 0; i < size; i++)
-      *(uint8_t*) (buffer + i) = input_getc();
-    ret = size;
+  for (e = list_begin (&t->fd_list); e != list_end (&t->fd_list);
+       e = list_next (e))
+  {
+    struct fd_elem *fd_elem = list_entry (e, struct fd_elem, elem);
+    if (fd_elem->fd == fd)
+      return fd_elem->file;
   }
+  return NULL;
+}
+
+/* Returns how much of the SIZE bytes at user address BUFFER to pin
+   for one step of a read or write: up to the end of the PIN_CHUNK'th
+   page. */
+static unsigned
+pin_chunk (const void* buffer, unsigned size)
+{
+  unsigned chunk = PIN_CHUNK - pg_ofs (buffer);
+  return size < chunk ? size : chunk;
+}
+
+/* The buffer is moved in chunks whose pages are pinned first, so that
+   file_read() and file_write() never fault while holding file_lock,
+   which the fault handler may need. */
+int sys_read (int fd, void *buffer, unsigned size)
+{
+  /* read in file according to input type */
+  struct file *file_ptr = NULL;
+  int ret = 0;
 
   /* STDOUT */
-  if (fd == 1){
-    ret = -1;
-  }
+  if (fd == 1)
+    return -1;
 
   /* OPEN FD */
-  if (fd != 0 && fd != 1){
-    struct list_elem *e;
-    struct fd_elem *fd_read = NULL;
-    struct file *file_ptr = NULL;
-    struct thread *t = thread_current();
+  if (fd != 0)
+  {
+    file_ptr = fd_file (fd);
+    if (file_ptr == NULL)
+      return -1;
+  }
 
-    for (e = list_begin (&t->fd_list); e != list_end (&t->fd_list);
-         e = list_next (e)) {
-      fd_read = list_entry (e, struct fd_elem, elem);
-      if(fd_read->fd == fd){
-        file_ptr = fd_read->file;
-        if (file_ptr)
-        {
-          lock_acquire(&swap_lock);
-          lock_acquire(&file_lock);
-          ret = file_read(file_ptr, buffer, size);
-          lock_release(&file_lock);
-          lock_release(&swap_lock);
-        }
-        else
-          ret = -1;
-        break;
+  if (!user_range_ok (buffer, size))
+    sys_exit (-1);
+  while (size > 0)
+  {
+    unsigned chunk = pin_chunk (buffer, size);
+    unsigned i;
+    int n;
 
-      }
+    // the buffer is written to, so it must not be read-only
+    pin_buffer (buffer, chunk, true);
+    if (fd == 0)
+    {
+      for (i = 0; i < chunk; i++)
+        *(uint8_t*) (buffer + i) = input_getc();
+      n = chunk;
+    }
+    else
+    {
+      lock_acquire(&file_lock);
+      n = file_read(file_ptr, buffer, chunk);
+      lock_release(&file_lock);
     }
+    unpin_buffer (buffer, chunk);
+
+    ret += n;
+    if ((unsigned) n < chunk)
+      break;
+    buffer += chunk;
+    size -= chunk;
   }
   return ret;
 }
@@ -221,48 +302,49 @@ int
 sys_write (int fd, const void *buffer, unsigned size)
 {
   /* read in file according to input type */
-  int ret = -1;
+  struct file *file_ptr = NULL;
+  int ret = 0;
 
   /* STDIN */
-  if (fd == 0){
-    ret = -1;
-  }
-
-  /* STDOUT */
-  if (fd == 1){
-    putbuf(buffer, size);
-    ret = size;
-  }
+  if (fd == 0)
+    return -1;
 
   /* OPEN FD */
-  if (fd != 0 && fd != 1){
-    struct list_elem *e;
-    struct fd_elem *fd_write = NULL;
-    struct file *file_ptr = NULL;
-    struct thread *t = thread_current();
+  if (fd != 1)
+  {
+    file_ptr = fd_file (fd);
+    if (file_ptr == NULL)
+      return -1;
+  }
 
-    for (e = list_begin (&t->fd_list); e != list_end (&t->fd_list);
-         e = list_next (e)) {
-      fd_write = list_entry (e, struct fd_elem, elem);
-      if(fd_write->fd == fd){
-        file_ptr = fd_write->file;
-        if (file_ptr)
-        {
-          lock_acquire(&swap_lock);
-          lock_acquire(&file_lock);
-          ret = file_write(file_ptr, buffer, size);
-          lock_release(&file_lock);
-          lock_release(&swap_lock);
-        }
-        else
-          ret = -1;
+  if (!user_range_ok (buffer, size))
+    sys_exit (-1);
+  while (size > 0)
+  {
+    unsigned chunk = pin_chunk (buffer, size);
+    int n;
 
-        break;
-      }
+    pin_buffer (buffer, chunk, false);
+    /* STDOUT */
+    if (fd == 1)
+    {
+      putbuf(buffer, chunk);
+      n = chunk;
     }
-  }
-
+    else
+    {
+      lock_acquire(&file_lock);
+      n = file_write(file_ptr, buffer, chunk);
+      lock_release(&file_lock);
+    }
+    unpin_buffer (buffer, chunk);
 
+    ret += n;
+    if ((unsigned) n < chunk)
+      break;
+    buffer += chunk;
+    size -= chunk;
+  }
   return ret;
 }
 
@@ -322,22 +404,178 @@ unsigned sys_tell (int fd)
   return ret;
 }
 
+/* Reads a byte at user virtual address UADDR, which must be below
+   PHYS_BASE. Returns the byte value if successful, -1 if a segfault
+   occurred. The page fault handler recovers from a bad address by
+   jumping to the address this leaves in EAX. */
+static int
+get_user (const uint8_t *uaddr)
+{
+  int result;
+  asm ("movl $1f, %0; movzbl %1, %0; 1:"
+       : "=&a" (result) : "m" (*uaddr));
+  return result;
+}
+
+/* Writes BYTE to user address UDST, which must be below PHYS_BASE.
+   Returns true if successful, false if a segfault occurred. */
+static bool
+put_user (uint8_t *udst, uint8_t byte)
+{
+  int error_code;
+  asm ("movl $1f, %0; movb %b2, %1; 1:"
+       : "=&a" (error_code), "=m" (*udst) : "q" (byte));
+  return error_code != -1;
+}
+
+/* Returns true if the SIZE bytes at UADDR are all user addresses. The
+   kernel can read its own memory without faulting, so get_user() and
+   put_user() can't tell us this. */
+static bool
+user_range_ok (const void* uaddr, size_t size)
+{
+  const uint8_t* last = (const uint8_t*) uaddr + size - 1;
+  return size == 0 || (last >= (const uint8_t*) uaddr && is_user_vaddr (last));
+}
+
+/* Faults in the SIZE bytes at user address UADDR, which lie below
+   PHYS_BASE, and pins their pages, checking that they are writable
+   too if WRITE is true. Each page is touched once, so the cost is per
+   page, not per byte. Kills the process if some page isn't valid. */
+static void
+pin_buffer (const void* uaddr, size_t size, bool write)
+{
+  uint8_t* start = pg_round_down (uaddr);
+  uint8_t* end = (uint8_t*) uaddr + size;
+  uint8_t* p;
+
+  for (p = start; p < end; p += PGSIZE)
+  {
+    uint8_t* probe = p < (uint8_t*) uaddr ? (uint8_t*) uaddr : p;
+    do
+    {
+      int c = get_user (probe);
+      if (c == -1 || (write && !put_user (probe, c)))
+      {
+        if (p > start)
+          unpin_buffer (uaddr, p - (uint8_t*) uaddr);
+        sys_exit (-1);
+      }
+    }
+    // the page can be evicted again before it is pinned
+    while (!page_pin (p, write));
+  }
+}
+
+/* Unpins the pages pinned by pin_buffer (UADDR, SIZE, ...). */
+static void
+unpin_buffer (const void* uaddr, size_t size)
+{
+  uint8_t* end = (uint8_t*) uaddr + size;
+  uint8_t* p;
+
+  for (p = pg_round_down (uaddr); p < end; p += PGSIZE)
+    page_unpin (p);
+}
+
+/* Checks that the null-terminated string at user address USTR is
+   mapped, one page at a time. */
+static bool
+check_string (const char* ustr)
+{
+  const char* p = ustr;
+
+  for (;;)
+  {
+    const char* page_end = pg_round_down (p) + PGSIZE;
+    if (!is_user_vaddr (p) || get_user ((const uint8_t*) p) == -1)
+      return false;
+    // the page is valid, so the rest of it can be read directly
+    for (; p < page_end; p++)
+      if (*p == '\0')
+        return true;
+  }
+}
+
+/* Copies SIZE bytes from user address USRC to kernel address DST.
+   Returns false, having copied part of the data, if some of the user
+   memory isn't mapped. */
+bool
+copy_from_user (void* dst, const void* usrc, size_t size)
+{
+  const uint8_t* src = usrc;
+  uint8_t* d = dst;
+
+  if (!user_range_ok (usrc, size))
+    return false;
+  while (size > 0)
+  {
+    size_t chunk = PGSIZE - pg_ofs (src);
+    if (chunk > size)
+      chunk = size;
+    // fault the page in, or find out it isn't there; the rest of it
+    // can then be copied in one go
+    if (get_user (src) == -1)
+      return false;
+    memcpy (d, src, chunk);
+    src += chunk;
+    d += chunk;
+    size -= chunk;
+  }
+  return true;
+}
+
+/* Copies SIZE bytes from kernel address SRC to user address UDST.
+   Returns false, having copied part of the data, if some of the user
+   memory isn't mapped writable. */
+bool
+copy_to_user (void* udst, const void* src, size_t size)
+{
+  uint8_t* dst = udst;
+  const uint8_t* s = src;
+
+  if (!user_range_ok (udst, size))
+    return false;
+  while (size > 0)
+  {
+    size_t chunk = PGSIZE - pg_ofs (dst);
+    if (chunk > size)
+      chunk = size;
+    if (!put_user (dst, *s))
+      return false;
+    memcpy (dst + 1, s + 1, chunk - 1);
+    dst += chunk;
+    s += chunk;
+    size -= chunk;
+  }
+  return true;
+}
+
+/* Copies the system call's first CNT arguments from the user's stack
+   into ARGS, killing the process if they aren't readable. */
+static void
+get_args (struct intr_frame *f, int* args, int cnt)
+{
+  if (!copy_from_user (args, (int*) f->esp + 1, cnt * sizeof *args))
+    sys_exit (-1);
+}
+
 static void
 syscall_handler (struct intr_frame *f)
 {
-  // we need to check the address first
-  // the system call number is on the user's stack in the user's virtual address space
-  // terminates the process if the address is illegal
-  check_address (f->esp, f);
+  int sys_call_id;
+  int args[3];
 
-  void* arg1;
-  void* arg2;
-  void* arg3;
-  int i;
+  // the kernel may fault on the user's stack while handling the call,
+  // and then needs to know where it was to grow it
+  thread_current ()->syscall_esp = f->esp;
 
-  // if we get to this point, the address is legal
-  int sys_call_id = *(int*)f->esp;
-  ASSERT (sys_call_id >= 0 && sys_call_id < 14);
+  // the system call number is on the user's stack in the user's virtual address space
+  // terminates the process if the address is illegal
+  // so does a number that isn't a system call at all
+  if (!copy_from_user (&sys_call_id, f->esp, sizeof sys_call_id)
+      || sys_call_id < 0 || sys_call_id > SYS_VMSTAT)
+    sys_exit (-1);
 
   switch (sys_call_id){
     case SYS_HALT:
@@ -345,183 +583,93 @@ syscall_handler (struct intr_frame *f)
       break;
 
     case SYS_EXIT:
-      arg1 = f->esp + 4;
-      check_address (arg1, f);
-      sys_exit(*(int*)arg1);
+      get_args (f, args, 1);
+      sys_exit(args[0]);
       break;
 
     case SYS_EXEC:
-      arg1 = f->esp + 4;
-      check_address (arg1, f);
-      for (i = 0; i < 14; i++) // file names can only have 14 characters or fewer
-        check_address(*(char**)arg1+i, f);
-      f->eax = sys_exec(*(char**)arg1);
+      get_args (f, args, 1);
+      if (!check_string ((const char*) args[0]))
+        sys_exit (-1);
+      f->eax = sys_exec((const char*) args[0]);
       break;
 
     case SYS_WAIT:
-      arg1 = f->esp + 4;
-      check_address (arg1, f);
-      f->eax = sys_wait(*(tid_t*)arg1);
+      get_args (f, args, 1);
+      f->eax = sys_wait(args[0]);
       break;
 
     case SYS_CREATE:
-      arg1 = f->esp + 4;
-      arg2 = arg1 + 4;
-      check_address (arg1, f);
-      for (i = 0; i < 14; i++) // file names can only have 14 characters or fewer
-        check_address(*(char**)arg1+i, f);
-      check_address (arg2, f);
-      f->eax = sys_create(*(char**)arg1, *(unsigned*)arg2);
+      get_args (f, args, 2);
+      if (!check_string ((const char*) args[0]))
+        sys_exit (-1);
+      f->eax = sys_create((const char*) args[0], args[1]);
       break;
 
     case SYS_REMOVE:
-      arg1 = f->esp + 4;
-      check_address (arg1, f);
-      sys_remove(*(int*)arg1);
+      get_args (f, args, 1);
+      if (!check_string ((const char*) args[0]))
+        sys_exit (-1);
+      f->eax = sys_remove((const char*) args[0]);
       break;
 
     case SYS_OPEN:
-      arg1 = f->esp + 4;
-      check_address (arg1, f);
-      if (strlen(*(char**)arg1) > 0)
-        for (i = 0; i < strlen(*(char**)arg1)-1; i++) // file names can only have 14 characters or fewer
-          check_address(*(char**)arg1+i, f);
-      else
-        f->eax = -1;
-      f->eax = sys_open(*(char**)arg1);
+      get_args (f, args, 1);
+      if (!check_string ((const char*) args[0]))
+        sys_exit (-1);
+      f->eax = sys_open((const char*) args[0]);
       break;
 
     case SYS_FILESIZE:
-      arg1 = f->esp + 4;
-      check_address(arg1, f);
-      f->eax = sys_filesize(*(int*)arg1);
+      get_args (f, args, 1);
+      f->eax = sys_filesize(args[0]);
       break;
 
     case SYS_READ:
-      arg1 = f->esp + 4;
-      arg2 = f->esp + 8;
-      arg3 = f->esp + 12;
-      check_address (arg1, f);
-      check_address (arg2, f);
-      check_page (arg2); // make sure we aren't trying to write to an unwritable page
-      check_address (arg3, f);
-      for (i = 0; i < *(int*)arg3; i++)
-        check_address (*(char**)arg2+i, f);
-      f->eax = sys_read (*(int*)arg1, *(char**)arg2, *(int*)arg3);
+      get_args (f, args, 3);
+      f->eax = sys_read (args[0], (void*) args[1], args[2]);
       break;
 
     case SYS_WRITE:
-      arg1 = f->esp + 4;
-      arg2 = f->esp + 8;
-      arg3 = f->esp + 12;
-      check_address (arg1, f);
-      check_address (arg2, f);
-      check_address (arg3, f);
-      for (i = 0; i < *(int*)arg3; i++)
-        check_address(*(char**)arg2+i, f);
-      f->eax = sys_write (*(int*)arg1, *(char**)arg2, *(int*)arg3);
+      get_args (f, args, 3);
+      f->eax = sys_write (args[0], (void*) args[1], args[2]);
       break;
 
     case SYS_SEEK:
-      arg1 = f->esp + 4;
-      arg2 = f->esp + 8;
-      check_address(arg1, f);
-      check_address(arg2, f);
-      sys_seek(*(int*)arg1, *(unsigned*)arg2);
+      get_args (f, args, 2);
+      sys_seek(args[0], args[1]);
       break;
 
     case SYS_TELL:
-      arg1 = f->esp + 4;
-      check_address(arg1, f);
-      f->eax = sys_tell(*(int*)arg1);
+      get_args (f, args, 1);
+      f->eax = sys_tell(args[0]);
       break;
 
     case SYS_CLOSE:
-      arg1 = f->esp + 4;
-      check_address (arg1, f);
-      sys_close(*(int**)arg1);
+      get_args (f, args, 1);
+      sys_close(args[0]);
       break;
-  }
 
-}
+    case SYS_MMAP:
+      get_args (f, args, 2);
+      f->eax = sys_mmap (args[0], (void*) args[1]);
+      break;
 
-/* New function to check whether an address passed in to a system call
-   is valid, i.e. it is not null, it is not a kernel virtual address, and it is
-   not unmapped. As of project 3, only kills the thread if the invalid address is
-   not associated with an entry in the SPT or is not close to the stack. */
-void
-check_address (void* addr, struct intr_frame *f)
-{
-  int i;
-  struct thread* cur = thread_current();
+    case SYS_MUNMAP:
+      get_args (f, args, 1);
+      sys_munmap (args[0]);
+      break;
 
-  for (i = 0; i < 4; i++)
-  {
-    // if the initial address is null or a kernel address, we definitely need to exit
-    if (addr+i == NULL || is_kernel_vaddr(addr+i))
-    {
-      lock_acquire(&cur->element->lock);
-      cur->element->exit_status = -1;
-      lock_release(&cur->element->lock);
-      thread_exit();
-    }
-    uint32_t* pd = thread_current()->pagedir;
-    void* kernel_addr = pagedir_get_page(pd, addr+i);
-    // kernel_addr is only NULL if addr points to unmapped virtual memory
-    // if the user passed in an unmapped address, we want to exit
-    if (kernel_addr == NULL)
-    {
-      struct hash_elem* e;
-      struct page_table_elem p;
-      p.page_no = pg_no (addr+i);
-      lock_acquire(&cur->spt_lock);
-      e = hash_find (&cur->s_page_table, &p.elem);
-      lock_release(&cur->spt_lock);
-      // if the page isn't in the supplemental page table, then we can't load it,
-      // so kill the thread
-      if (e == NULL)
-      {
-        // if the address should be invalid but it is close to the stack,
-        // add a new page to the stack for it
-        if ((int)f->esp - (int)addr <= 32 && (int)f->esp - (int)addr > -131072 && (int)f->esp - (int)addr != 0)
-        {
-          add_stack_page(f, addr+i);
-          return;
-        }
-        lock_acquire(&cur->element->lock);
-        cur->element->exit_status = -1;
-        lock_release(&cur->element->lock);
-        thread_exit();
-      }
-      // if the address is unmapped but DOES correspond to an entry in the SPT,
-      // load that entry now to prevent a page fault later
-      else
-      {
-        add_spt_page(f, addr+i);
-      }
-    }
-  }
-}
+    case SYS_FORK:
+      f->eax = sys_fork (f);
+      break;
 
-/* Checks that we are not trying to write to an unwritable page.
-   If we are, kills the thread. */
-void check_page (void* addr)
-{
-  struct thread* cur = thread_current();
-  struct hash_elem* e;
-  struct page_table_elem p;
-  p.page_no = pg_no (*(char**)addr);
-  lock_acquire(&cur->spt_lock);
-  e = hash_find (&cur->s_page_table, &p.elem);
-  struct page_table_elem* entry = hash_entry(e, struct page_table_elem, elem);
-  lock_release(&cur->spt_lock);
-  if (entry != NULL && entry->writable == false)
-  {
-    lock_acquire(&cur->element->lock);
-    cur->element->exit_status = -1;
-    lock_release(&cur->element->lock);
-    thread_exit();
+    case SYS_VMSTAT:
+      get_args (f, args, 2);
+      f->eax = sys_vmstat ((struct vmstat*) args[0], args[1]);
+      break;
   }
+
 }
 
 /* Releases all locks held by a given thread. Called before a thread
@@ -1,6 +1,11 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 void syscall_init (void);
+bool copy_from_user (void* dst, const void* usrc, size_t size);
+bool copy_to_user (void* udst, const void* src, size_t size);
 
 #endif /* userprog/syscall.h */
@@ -0,0 +1,89 @@
+#include "vm/evict.h"
+#include <round.h>
+#include "userprog/pagedir.h"
+
+/* Aging, an LRU approximation. Every AGING_PERIOD timer ticks each
+   resident page's 8-bit counter is shifted right and its accessed bit
+   is shifted in at the top. The page with the smallest counter is the
+   least recently used one.
+
+   The sampling runs in the timer interrupt, so each tick only looks at
+   a slice of the frame table, of at most AGING_SLICE frames. With many
+   frames a page is sampled less often than every AGING_PERIOD ticks,
+   but interrupt latency stays the same however much memory there is. */
+
+#define AGING_PERIOD 4          /* Timer ticks between samples. */
+#define AGING_SLICE 64          /* Most frames sampled per tick. */
+
+static int hand;
+static int age_hand;            /* Next frame for aging_tick() to sample. */
+
+static void
+aging_resident (struct frame_entry* frame)
+{
+  // a page that was just faulted in has just been used
+  frame->age = 0x80;
+}
+
+/* Samples the accessed bits. Runs with interrupts off, so it must not
+   take locks: frames that are locked or pinned are in the middle of
+   being filled or evicted and are skipped, which also guarantees that
+   the owners' page directories are still there and, with interrupts
+   off, stands in for the frame lock evict_referenced() wants. */
+static void
+aging_tick (void)
+{
+  int slice = DIV_ROUND_UP (user_pgs, AGING_PERIOD);
+  int i;
+
+  if (slice > AGING_SLICE)
+    slice = AGING_SLICE;
+  for (i = 0; i < slice; i++)
+  {
+    struct frame_entry* frame = &frame_table[age_hand];
+    if (++age_hand == user_pgs)
+      age_hand = 0;
+    if ((frame->spte == NULL && frame->share == NULL)
+        || frame->pinned || frame->lock.holder != NULL)
+      continue;
+
+    frame->age >>= 1;
+    if (evict_referenced (frame))
+      frame->age |= 0x80;
+  }
+  pagedir_flush_deferred ();
+}
+
+/* Picks the evictable frame with the smallest counter. The scan starts
+   where the last one ended so that ties don't always fall on the same
+   frames. */
+static struct frame_entry*
+aging_pick (void)
+{
+  struct frame_entry* best = NULL;
+  int i;
+
+  for (i = 0; i < user_pgs; i++)
+  {
+    struct frame_entry* frame = &frame_table[(hand + i) % user_pgs];
+    if (best != NULL && frame->age >= best->age)
+      continue;
+    if (!evict_try_lock (frame))
+      continue;
+    if (best != NULL)
+      lock_release (&best->lock);
+    best = frame;
+    if (best->age == 0)
+      break;
+  }
+  hand = (hand + i + 1) % user_pgs;
+  return best;
+}
+
+const struct evict_policy aging_policy =
+  {
+    .name = "aging",
+    .pick = aging_pick,
+    .resident = aging_resident,
+    .tick = aging_tick,
+  };
@@ -0,0 +1,296 @@
+#include "vm/evict.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include "threads/malloc.h"
+
+/* Adaptive Replacement Cache. Resident pages live on T1 (seen once)
+   or T2 (seen again); B1 and B2 remember the pages recently evicted
+   from each. A fault on a page in B1 means T1 was too small and grows
+   the target P; a fault on a page in B2 shrinks it.
+
+   The hardware does not tell us about hits, so they are observed
+   through the accessed bit when a page reaches the head of its list:
+   a referenced page moves to the tail of T2 instead of being evicted,
+   as in CAR (Bansal and Modha's clock version of ARC). */
+
+enum arc_list
+  {
+    ARC_NONE,                   /* Not on any list. */
+    ARC_T1,                     /* Recency list. */
+    ARC_T2                      /* Frequency list. */
+  };
+
+/* A remembered, no longer resident page. The key is the page's SPT
+   entry, or its shared page for shared text, which is only compared,
+   never dereferenced, so a stale key can at worst cause one spurious
+   ghost hit. Ghosts are also indexed by key, so that a page-in does
+   not have to walk B1 and B2. */
+struct arc_ghost
+  {
+    struct list_elem elem;
+    struct hash_elem hash_elem; // element in ghost_index
+    const void* key;
+    struct list* list;          // B1 or B2
+  };
+
+static struct list t1, t2, b1, b2;
+static size_t t1_cnt, t2_cnt, b1_cnt, b2_cnt;
+static size_t p;                /* Target size of T1. */
+static struct hash ghost_index; /* Ghosts on B1 and B2, by key. */
+
+static unsigned
+ghost_hash (const struct hash_elem* e, void* aux UNUSED)
+{
+  const struct arc_ghost* g = hash_entry (e, struct arc_ghost, hash_elem);
+  return hash_bytes (&g->key, sizeof g->key);
+}
+
+static bool
+ghost_less (const struct hash_elem* a, const struct hash_elem* b,
+            void* aux UNUSED)
+{
+  return hash_entry (a, struct arc_ghost, hash_elem)->key
+         < hash_entry (b, struct arc_ghost, hash_elem)->key;
+}
+
+static void
+arc_init (void)
+{
+  list_init (&t1);
+  list_init (&t2);
+  list_init (&b1);
+  list_init (&b2);
+  if (!hash_init (&ghost_index, ghost_hash, ghost_less, NULL))
+    PANIC ("arc: cannot allocate ghost index");
+}
+
+static const void*
+frame_key (const struct frame_entry* frame)
+{
+  return frame->share != NULL ? (const void*) frame->share : (const void*) frame->spte;
+}
+
+static void
+push_frame (struct frame_entry* frame, enum arc_list which)
+{
+  frame->policy_list = which;
+  if (which == ARC_T1)
+  {
+    list_push_back (&t1, &frame->policy_elem);
+    t1_cnt++;
+  }
+  else
+  {
+    list_push_back (&t2, &frame->policy_elem);
+    t2_cnt++;
+  }
+}
+
+static void
+remove_frame (struct frame_entry* frame)
+{
+  if (frame->policy_list == ARC_NONE)
+    return;
+  list_remove (&frame->policy_elem);
+  if (frame->policy_list == ARC_T1)
+    t1_cnt--;
+  else
+    t2_cnt--;
+  frame->policy_list = ARC_NONE;
+}
+
+/* Returns the ghost for KEY, on either ghost list, or NULL. */
+static struct arc_ghost*
+find_ghost (const void* key)
+{
+  struct arc_ghost g;
+  struct hash_elem* e;
+
+  g.key = key;
+  e = hash_find (&ghost_index, &g.hash_elem);
+  return e != NULL ? hash_entry (e, struct arc_ghost, hash_elem) : NULL;
+}
+
+/* Removes G from its list and the index, and frees it. */
+static void
+free_ghost (struct arc_ghost* g)
+{
+  list_remove (&g->elem);
+  hash_delete (&ghost_index, &g->hash_elem);
+  if (g->list == &b1)
+    b1_cnt--;
+  else
+    b2_cnt--;
+  free (g);
+}
+
+/* Removes and frees the ghost for KEY from GHOSTS, if it is there.
+   Returns true if it was found. */
+static bool
+take_ghost (struct list* ghosts, const void* key)
+{
+  struct arc_ghost* g = find_ghost (key);
+
+  if (g == NULL || g->list != ghosts)
+    return false;
+  free_ghost (g);
+  return true;
+}
+
+static void
+drop_oldest_ghost (struct list* ghosts)
+{
+  free_ghost (list_entry (list_front (ghosts), struct arc_ghost, elem));
+}
+
+/* Remembers KEY on GHOSTS and trims the ghost lists back to ARC's
+   bounds: |T1| + |B1| <= c and everything together <= 2c. */
+static void
+add_ghost (struct list* ghosts, size_t* cnt, const void* key)
+{
+  size_t c = user_pgs;
+  struct arc_ghost* g;
+
+  // a stale key may still have a ghost of its own
+  g = find_ghost (key);
+  if (g != NULL)
+    free_ghost (g);
+
+  g = malloc (sizeof *g);
+  if (g != NULL)
+  {
+    g->key = key;
+    g->list = ghosts;
+    list_push_back (ghosts, &g->elem);
+    hash_insert (&ghost_index, &g->hash_elem);
+    (*cnt)++;
+  }
+  while (t1_cnt + b1_cnt > c && b1_cnt > 0)
+    drop_oldest_ghost (&b1);
+  while (t1_cnt + t2_cnt + b1_cnt + b2_cnt > 2 * c && b2_cnt > 0)
+    drop_oldest_ghost (&b2);
+}
+
+static void
+arc_resident (struct frame_entry* frame)
+{
+  size_t c = user_pgs;
+  size_t delta;
+
+  remove_frame (frame);
+  if (b1_cnt > 0 && take_ghost (&b1, frame_key (frame)))
+  {
+    // recency miss: give T1 more room
+    delta = b1_cnt + 1 >= b2_cnt ? 1 : b2_cnt / (b1_cnt + 1);
+    p = p + delta < c ? p + delta : c;
+    push_frame (frame, ARC_T2);
+  }
+  else if (b2_cnt > 0 && take_ghost (&b2, frame_key (frame)))
+  {
+    // frequency miss: give T2 more room
+    delta = b2_cnt + 1 >= b1_cnt ? 1 : b1_cnt / (b2_cnt + 1);
+    p = p > delta ? p - delta : 0;
+    push_frame (frame, ARC_T2);
+  }
+  else
+    push_frame (frame, ARC_T1);
+}
+
+static void
+arc_released (struct frame_entry* frame)
+{
+  remove_frame (frame);
+}
+
+/* Returns the first element of L from E on, going round to the front
+   of L at most once, whose frame the pick in progress wants, or
+   list_end (L) if there is none. Frames of other processes are passed
+   over where they are, since their place in L says nothing about this
+   pick, but each one costs a unit of *BUDGET. */
+static struct list_elem*
+next_candidate (struct list* l, struct list_elem* e, size_t* budget)
+{
+  bool wrapped = false;
+
+  for (;;)
+  {
+    if (e == list_end (l))
+    {
+      if (wrapped)
+        return e;
+      wrapped = true;
+      e = list_begin (l);
+      continue;
+    }
+    if (!evict_filtered (list_entry (e, struct frame_entry, policy_elem)))
+      return e;
+    if (*budget == 0)
+      return list_end (l);
+    (*budget)--;
+    e = list_next (e);
+  }
+}
+
+static struct frame_entry*
+arc_pick (void)
+{
+  size_t budget = 2 * (t1_cnt + t2_cnt) + 1;
+  struct list_elem* c1 = list_begin (&t1);
+  struct list_elem* c2 = list_begin (&t2);
+
+  while (budget-- > 0)
+  {
+    bool from_t1;
+    struct list_elem* e;
+
+    // the heads of the lists, as far as this pick is concerned
+    c1 = next_candidate (&t1, c1, &budget);
+    c2 = next_candidate (&t2, c2, &budget);
+    if (c1 == list_end (&t1) && c2 == list_end (&t2))
+      return NULL;
+    from_t1 = c1 != list_end (&t1)
+              && (t1_cnt >= (p > 1 ? p : 1) || c2 == list_end (&t2));
+
+    struct list* l = from_t1 ? &t1 : &t2;
+    e = from_t1 ? c1 : c2;
+    struct frame_entry* frame = list_entry (e, struct frame_entry, policy_elem);
+    if (from_t1)
+      c1 = list_next (e);
+    else
+      c2 = list_next (e);
+
+    if (!evict_try_lock (frame))
+    {
+      // busy or pinned: look at it again later
+      list_remove (&frame->policy_elem);
+      list_push_back (l, &frame->policy_elem);
+      continue;
+    }
+    if (evict_referenced (frame))
+    {
+      // a hit: promote to (or keep in) the frequency list
+      lock_release (&frame->lock);
+      remove_frame (frame);
+      push_frame (frame, ARC_T2);
+      continue;
+    }
+
+    remove_frame (frame);
+    if (from_t1)
+      add_ghost (&b1, &b1_cnt, frame_key (frame));
+    else
+      add_ghost (&b2, &b2_cnt, frame_key (frame));
+    return frame;
+  }
+  return NULL;
+}
+
+const struct evict_policy arc_policy =
+  {
+    .name = "arc",
+    .init = arc_init,
+    .pick = arc_pick,
+    .resident = arc_resident,
+    .released = arc_released,
+  };
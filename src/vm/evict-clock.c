@@ -0,0 +1,36 @@
+#include "vm/evict.h"
+#include "vm/vmstat.h"
+
+/* Second-chance clock. The hand sweeps the frame table, clearing
+   accessed bits, and stops at the first frame that was not
+   referenced since the hand last passed it. */
+
+static int hand;
+
+static struct frame_entry*
+clock_pick (void)
+{
+  int scanned;
+
+  // two revolutions: the first may only clear accessed bits
+  for (scanned = 0; scanned < 2 * user_pgs; scanned++)
+  {
+    struct frame_entry* frame = &frame_table[hand];
+    hand = (hand + 1) % user_pgs;
+    if (hand == 0)
+      vmstat_add (clock_turns, 1);
+
+    if (!evict_try_lock (frame))
+      continue;
+    if (!evict_referenced (frame))
+      return frame;
+    lock_release (&frame->lock);
+  }
+  return NULL;
+}
+
+const struct evict_policy clock_policy =
+  {
+    .name = "clock",
+    .pick = clock_pick,
+  };
@@ -0,0 +1,82 @@
+#include "vm/evict.h"
+#include "devices/timer.h"
+#include "vm/vmstat.h"
+
+/* WSClock. Like the clock, but a page is only a victim once it has
+   been unreferenced for longer than the working-set window, and clean
+   pages are preferred because evicting them costs no disk write. If a
+   full revolution finds no clean page outside the working set, the
+   first dirty one is taken, then any unreferenced page at all. */
+
+#define WSCLOCK_TAU (TIMER_FREQ / 2)    /* Working-set window, in ticks. */
+
+static int hand;
+
+static void
+wsclock_resident (struct frame_entry* frame)
+{
+  frame->last_use = timer_ticks ();
+}
+
+static struct frame_entry*
+wsclock_pick (void)
+{
+  struct frame_entry* dirty_old = NULL;   // first dirty page out of the working set
+  struct frame_entry* fallback = NULL;    // first unreferenced page in the working set
+  int64_t now = timer_ticks ();
+  int scanned;
+
+  for (scanned = 0; scanned < 2 * user_pgs; scanned++)
+  {
+    // after one revolution, settle for what we have
+    if (scanned == user_pgs && (dirty_old != NULL || fallback != NULL))
+      break;
+
+    struct frame_entry* frame = &frame_table[hand];
+    hand = (hand + 1) % user_pgs;
+    if (hand == 0)
+      vmstat_add (clock_turns, 1);
+
+    if (frame == dirty_old || frame == fallback || !evict_try_lock (frame))
+      continue;
+    if (evict_referenced (frame))
+      frame->last_use = now;
+    else if (now - frame->last_use > WSCLOCK_TAU)
+    {
+      if (!evict_is_dirty (frame))
+      {
+        if (dirty_old != NULL)
+          lock_release (&dirty_old->lock);
+        if (fallback != NULL)
+          lock_release (&fallback->lock);
+        return frame;
+      }
+      if (dirty_old == NULL)
+      {
+        dirty_old = frame;
+        continue;
+      }
+    }
+    else if (fallback == NULL)
+    {
+      fallback = frame;
+      continue;
+    }
+    lock_release (&frame->lock);
+  }
+
+  if (dirty_old != NULL)
+  {
+    if (fallback != NULL)
+      lock_release (&fallback->lock);
+    return dirty_old;
+  }
+  return fallback;
+}
+
+const struct evict_policy wsclock_policy =
+  {
+    .name = "wsclock",
+    .pick = wsclock_pick,
+    .resident = wsclock_resident,
+  };
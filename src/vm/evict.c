@@ -0,0 +1,332 @@
+#include "vm/evict.h"
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/pagedir.h"
+#include "vm/share.h"
+
+/* Policies selectable with -evict=NAME. The first one is the default. */
+static const struct evict_policy* policies[] =
+  {
+    &clock_policy,
+    &aging_policy,
+    &wsclock_policy,
+    &arc_policy,
+    NULL,
+  };
+
+/* The policy in use. */
+static const struct evict_policy* policy;
+
+/* Resident set limits, in pages. A process over its soft limit has
+   its pages evicted before anyone else's; with no -rss-soft the soft
+   limit is a fair share, the user pool divided among the processes
+   that have pages in it. A process at its hard limit replaces its own
+   pages, even if other frames are free. 0 means no limit. */
+static size_t rss_soft;
+static size_t rss_hard;
+static size_t rss_procs;        /* # of threads with rss > 0. */
+
+/* Which frames evict_try_lock() accepts while the policy picks. */
+enum evict_filter
+  {
+    FILTER_NONE,                /* Any frame. */
+    FILTER_THREAD,              /* Frames of filter_thread. */
+    FILTER_OVER_SOFT            /* Frames of threads over the soft limit. */
+  };
+static enum evict_filter filter;
+static struct thread* filter_thread; /* Only compared, never dereferenced. */
+
+static struct frame_entry* pick (enum evict_filter);
+static size_t soft_limit (void);
+static bool any_over_soft (void);
+static void rss_add (struct thread* t, int n);
+
+/* Statistics. */
+static long long page_in_cnt;   /* # of pages made resident. */
+static long long evict_cnt;     /* # of frames taken from a page. */
+
+/* Selects the replacement policy called NAME, or the default policy if
+   NAME is null, and sets the resident set limits to SOFT and HARD
+   pages. Must run after frame_init(). */
+void
+evict_init (const char* name, size_t soft, size_t hard)
+{
+  int i;
+
+  if (name == NULL)
+    policy = policies[0];
+  else
+    for (i = 0; policies[i] != NULL; i++)
+      if (!strcmp (policies[i]->name, name))
+        policy = policies[i];
+  if (policy == NULL)
+    PANIC ("unknown replacement policy `%s'", name);
+
+  if (policy->init != NULL)
+    policy->init ();
+  printf ("vm: using %s page replacement\n", policy->name);
+
+  rss_soft = soft;
+  rss_hard = hard;
+}
+
+/* Asks the policy for a victim. Returns it locked and pinned. If every
+   frame is pinned or busy, yields and tries again when WAIT is true,
+   or returns NULL when it is false. Pages of processes over their
+   soft limit go first, so that a process that outgrows its share of
+   memory mostly evicts its own pages. */
+struct frame_entry*
+evict_pick (bool wait)
+{
+  struct frame_entry* frame;
+
+  for (;;)
+  {
+    lock_acquire (&frame_lock);
+    frame = NULL;
+    if (any_over_soft ())
+      frame = pick (FILTER_OVER_SOFT);
+    if (frame == NULL)
+      frame = pick (FILTER_NONE);
+    lock_release (&frame_lock);
+    pagedir_flush_deferred ();
+
+    if (frame != NULL)
+      return frame;
+    if (!wait)
+      return NULL;
+    // give the other threads a chance to finish with their frames
+    thread_yield ();
+  }
+}
+
+/* Like evict_pick (false), but only picks one of T's own frames. For a
+   process at its hard limit, and for the page cleaner's batches. */
+struct frame_entry*
+evict_pick_of (struct thread* t)
+{
+  struct frame_entry* frame;
+
+  lock_acquire (&frame_lock);
+  filter_thread = t;
+  frame = pick (FILTER_THREAD);
+  lock_release (&frame_lock);
+  pagedir_flush_deferred ();
+  return frame;
+}
+
+/* Returns true if the current thread has reached its hard limit and
+   should replace its own pages rather than take another frame. */
+bool
+evict_at_hard_limit (void)
+{
+  return rss_hard > 0 && (size_t) thread_current ()->rss >= rss_hard;
+}
+
+/* Has the policy pick a victim among the frames WHICH selects, and
+   pins it and takes it out of its owner's resident set. frame_lock
+   must be held. */
+static struct frame_entry*
+pick (enum evict_filter which)
+{
+  struct frame_entry* frame;
+
+  filter = which;
+  frame = policy->pick ();
+  filter = FILTER_NONE;
+  if (frame == NULL)
+    return NULL;
+
+  frame->pinned = true;
+  if (frame->spte != NULL)
+    rss_add (frame->t, -1);
+  evict_cnt++;
+  return frame;
+}
+
+/* Returns the current soft limit. frame_lock must be held. */
+static size_t
+soft_limit (void)
+{
+  if (rss_soft > 0)
+    return rss_soft;
+  return rss_procs > 1 ? user_pgs / rss_procs : (size_t) user_pgs;
+}
+
+/* thread_foreach() helper for any_over_soft(). */
+static void
+check_over_soft (struct thread* t, void* over_)
+{
+  bool* over = over_;
+  if ((size_t) t->rss > soft_limit ())
+    *over = true;
+}
+
+/* Returns true if some thread is over the soft limit, so that a
+   filtered pick is worth a try. frame_lock must be held. */
+static bool
+any_over_soft (void)
+{
+  enum intr_level old_level;
+  bool over = false;
+
+  if (rss_procs < 2 && rss_soft == 0)
+    return false;
+  old_level = intr_disable ();
+  thread_foreach (check_over_soft, &over);
+  intr_set_level (old_level);
+  return over;
+}
+
+/* Adds N to T's resident set size. frame_lock must be held. */
+static void
+rss_add (struct thread* t, int n)
+{
+  bool was_resident = t->rss > 0;
+
+  t->rss += n;
+  if (!was_resident && t->rss > 0)
+    rss_procs++;
+  else if (was_resident && t->rss == 0)
+    rss_procs--;
+}
+
+/* Adds DELTA to T's resident set size, for a resident frame that
+   moves between T's private pages and a shared page: shared frames
+   count against nobody. */
+void
+evict_rss_change (struct thread* t, int delta)
+{
+  lock_acquire (&frame_lock);
+  rss_add (t, delta);
+  lock_release (&frame_lock);
+}
+
+/* Tells the policy that FRAME now holds FRAME->spte's page. */
+void
+evict_page_in (struct frame_entry* frame)
+{
+  page_in_cnt++;
+  lock_acquire (&frame_lock);
+  if (frame->spte != NULL)
+    rss_add (frame->t, 1);
+  if (policy->resident != NULL)
+    policy->resident (frame);
+  lock_release (&frame_lock);
+}
+
+/* Tells the policy that FRAME's page is going away without having been
+   picked. */
+void
+evict_release (struct frame_entry* frame)
+{
+  lock_acquire (&frame_lock);
+  if (frame->spte != NULL)
+    rss_add (frame->t, -1);
+  if (policy->released != NULL)
+    policy->released (frame);
+  lock_release (&frame_lock);
+}
+
+/* Timer tick hook. Runs in an external interrupt context. */
+void
+evict_tick (void)
+{
+  if (policy != NULL && policy->tick != NULL)
+    policy->tick ();
+}
+
+/* Prints replacement statistics. */
+void
+evict_print_stats (void)
+{
+  if (policy == NULL)
+    return;
+  printf ("Paging (%s): %lld page-ins, %lld evictions\n",
+          policy->name, page_in_cnt, evict_cnt);
+}
+
+/* Returns true if the pick in progress only wants some processes'
+   frames and FRAME is not one of them. Policies that keep frames in
+   order should leave such frames where they are. */
+bool
+evict_filtered (struct frame_entry* frame)
+{
+  // during a filtered pick, shared frames belong to nobody
+  if (filter == FILTER_THREAD)
+    return frame->spte == NULL || frame->t != filter_thread;
+  if (filter == FILTER_OVER_SOFT)
+    return frame->spte == NULL || (size_t) frame->t->rss <= soft_limit ();
+  return false;
+}
+
+/* Tries to lock FRAME for eviction. Fails without blocking if FRAME is
+   unused, pinned, locked by another thread, or filtered out. */
+bool
+evict_try_lock (struct frame_entry* frame)
+{
+  if (frame == NULL || (frame->spte == NULL && frame->share == NULL)
+      || frame->pinned || frame->pin_cnt > 0 || evict_filtered (frame))
+    return false;
+  if (!lock_try_acquire (&frame->lock))
+    return false;
+  // recheck now that the frame can't change under us
+  if ((frame->spte == NULL && frame->share == NULL) || frame->pinned
+      || frame->pin_cnt > 0)
+  {
+    lock_release (&frame->lock);
+    return false;
+  }
+  return true;
+}
+
+/* Returns and clears the accessed bit of SPTE's user mapping. The TLB
+   is brought up to date once per sweep, by evict_pick(). */
+static bool
+test_and_clear_accessed (struct page_table_elem* spte)
+{
+  return pagedir_test_and_clear_accessed (spte->t->pagedir, spte->addr);
+}
+
+/* Returns true if the page in FRAME, which must be locked, has been
+   referenced since the last call, and clears its accessed bit.  Only
+   the user mapping is consulted: the kernel alias is touched whenever
+   the kernel fills the frame, which says nothing about the process's
+   use of the page. A shared page counts as referenced if any of its
+   sharers used it. */
+bool
+evict_referenced (struct frame_entry* frame)
+{
+  struct list_elem* e;
+  bool referenced = false;
+
+  if (frame->share == NULL)
+    return test_and_clear_accessed (frame->spte);
+
+  // the sharers list only changes under the frame's lock
+  for (e = list_begin (&frame->share->sharers); e != list_end (&frame->share->sharers);
+       e = list_next (e))
+    if (test_and_clear_accessed (list_entry (e, struct page_table_elem, share_elem)))
+      referenced = true;
+  return referenced;
+}
+
+/* Returns true if evicting FRAME, which must be locked, requires
+   writing its page to swap. Only the user mapping is consulted: the
+   kernel alias is dirtied by every fill and is usually part of a 4 MB
+   page anyway. Writes the kernel makes on the process's behalf go
+   through the user address or mark it dirty explicitly. */
+bool
+evict_is_dirty (struct frame_entry* frame)
+{
+  uint32_t* pd;
+
+  // shared pages are read-only
+  if (frame->share != NULL)
+    return false;
+  pd = frame->t->pagedir;
+  return frame->spte->writable && pagedir_is_dirty (pd, frame->spte->addr);
+}
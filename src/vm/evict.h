@@ -0,0 +1,48 @@
+#ifndef EVICT_H
+#define EVICT_H
+
+#include <stdbool.h>
+#include "vm/frame.h"
+
+/* A page-replacement policy.  All hooks except tick() are called
+   with frame_lock held; tick() runs in the timer interrupt. */
+struct evict_policy
+  {
+    const char *name;
+    void (*init) (void);
+    // chooses a victim and returns it locked (see evict_try_lock()),
+    // or returns NULL if every frame is pinned or busy right now
+    struct frame_entry* (*pick) (void);
+    // FRAME has just been filled and mapped for FRAME->spte
+    void (*resident) (struct frame_entry* frame);
+    // FRAME's page went away without being picked (e.g. process exit)
+    void (*released) (struct frame_entry* frame);
+    // called on every timer tick; may be NULL
+    void (*tick) (void);
+  };
+
+/* The available policies. */
+extern const struct evict_policy clock_policy;
+extern const struct evict_policy aging_policy;
+extern const struct evict_policy wsclock_policy;
+extern const struct evict_policy arc_policy;
+
+struct thread;
+
+void evict_init (const char* name, size_t soft, size_t hard);
+struct frame_entry* evict_pick (bool wait);
+struct frame_entry* evict_pick_of (struct thread* t);
+bool evict_at_hard_limit (void);
+void evict_rss_change (struct thread* t, int delta);
+void evict_page_in (struct frame_entry* frame);
+void evict_release (struct frame_entry* frame);
+void evict_tick (void);
+void evict_print_stats (void);
+
+/* Helpers shared by the policies. */
+bool evict_filtered (struct frame_entry* frame);
+bool evict_try_lock (struct frame_entry* frame);
+bool evict_referenced (struct frame_entry* frame);
+bool evict_is_dirty (struct frame_entry* frame);
+
+#endif
@@ -1,52 +1,229 @@
 #include "vm/frame.h"
+#include <round.h>
+#include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "threads/thread.h"
+#include "vm/evict.h"
+#include "vm/swap.h"
 
+/* Kernel address of the first user frame. frame_table[i] describes
+   the frame at frame_base + i * PGSIZE. */
+static uint8_t* frame_base;
+
+/* Free frames, linked through their next_free members. Those on
+   ZERO_LIST are known to hold nothing but zeroes, see frame_zero_idle().
+   The lists are protected by disabling interrupts rather than by a
+   lock, so that the idle thread, which must never block, can use them
+   too. */
+static struct frame_entry* free_list;
+static struct frame_entry* zero_list;
+static size_t free_cnt;         // frames on either list
+static size_t zero_cnt;         // frames on zero_list
+
+/* The idle thread stops zeroing once this many frames are zeroed.
+   Zero-fill faults rarely come in bursts bigger than that, and frames
+   zeroed beyond it would mostly go to callers that overwrite them
+   anyway, wasting the work and the cache. */
+#define ZERO_RESERVE_DIV 8      // reserve is the user pool divided by this
+static size_t zero_target;
+
+static struct frame_entry* pop_free (struct frame_entry** list);
+
+/* Takes the whole user pool from palloc and builds the frame table
+   over it: one entry per frame, in frame order, all of them free.
+   From here on user frames are handed out and taken back only through
+   the frame table, so the fault path never touches palloc or malloc. */
 void frame_init ()
 {
+  size_t table_pages = DIV_ROUND_UP (user_pgs * sizeof *frame_table, PGSIZE);
+  int i;
+
   lock_init (&frame_lock);
+  frame_base = palloc_get_multiple (PAL_USER | PAL_ASSERT, user_pgs);
+  frame_table = palloc_get_multiple (PAL_ZERO | PAL_ASSERT, table_pages);
+
+  // build the free list back to front so frames are handed out in order
+  for (i = user_pgs - 1; i >= 0; i--)
+  {
+    struct frame_entry* entry = &frame_table[i];
+    lock_init (&entry->lock);
+    entry->va_ptr = frame_base + i * PGSIZE;
+    entry->next_free = free_list;
+    free_list = entry;
+  }
+  free_cnt = user_pgs;
+  zero_target = DIV_ROUND_UP (user_pgs, ZERO_RESERVE_DIV);
+}
+
+/* Returns the frame table entry for KPAGE, or NULL if KPAGE is not a
+   user frame. */
+struct frame_entry*
+frame_lookup (void* kpage)
+{
+  size_t idx = pg_no (kpage) - pg_no (frame_base);
+  if (frame_table == NULL || idx >= (size_t) user_pgs)
+    return NULL;
+  return &frame_table[idx];
 }
 
-/* Replaces calls to palloc_get_page(). Uses palloc_get_page() to
-   allocate a page, and adds an entry to the frame table about
-   that page. */
+/* Replaces calls to palloc_get_page(). Takes a frame off the free
+   list. If there is none, a page is evicted.
+
+   The frame is returned PINNED, so the eviction clock will not
+   touch it while the caller fills it and installs it.  The caller
+   must call frame_unpin() once the page is mapped. */
 void *
 allocate_page (enum palloc_flags flags)
 {
-  lock_acquire (&alloc_lock);
-  void* va_ptr;
+  void* va_ptr = NULL;
 
-  va_ptr = palloc_get_page(PAL_USER | flags);
-  // if this returns null, then we need to swap out a page
-  // this has to be done here otherwise we will fail in vtop
+  // a process at its hard limit pays for the new page with one of its own,
+  // even if there are free frames
+  if (evict_at_hard_limit ())
+    va_ptr = swap_out_own ();
+  if (va_ptr != NULL)
+  {
+    if (flags & PAL_ZERO)
+      memset (va_ptr, 0, PGSIZE);
+    return va_ptr;
+  }
+
+  va_ptr = try_allocate_page (flags);
+
+  // if this returns null, then we need to swap out a page.
+  // swap_out() hands the victim back to us already pinned, but with
+  // the old page still in it
   if (va_ptr == NULL)
   {
-    // if we need to acquire another page while swapping this one out (like for the stack),
-    // we can't be holding onto the alloc_lock while we do that
-    lock_release (&alloc_lock);
+    swap_check_watermark ();
     va_ptr = swap_out();
-    lock_acquire (&alloc_lock);
+    if (flags & PAL_ZERO)
+      memset (va_ptr, 0, PGSIZE);
   }
+  return va_ptr;
+}
 
-  // this is a VIRTUAL ADDRESS, so to get the frame number, we need
-  // to translate it
-  uintptr_t phys_ptr = vtop (va_ptr);
-  uintptr_t pfn = pg_no (phys_ptr);
+/* Like allocate_page(), but returns NULL instead of evicting when no
+   frame is free. For speculative work like read-ahead, which is not
+   worth pushing another page out for. */
+void *
+try_allocate_page (enum palloc_flags flags)
+{
+  struct frame_entry* entry;
+  enum intr_level old_level;
+
+  // callers that overwrite the whole frame leave the zeroed frames to
+  // the ones that want zeroes
+  old_level = intr_disable ();
+  if (flags & PAL_ZERO)
+    entry = zero_list != NULL ? pop_free (&zero_list) : pop_free (&free_list);
+  else
+    entry = free_list != NULL ? pop_free (&free_list) : pop_free (&zero_list);
+  intr_set_level (old_level);
+  if (entry == NULL)
+    return NULL;
 
-  // initialize the new frame table entry
-  struct frame_entry* entry = malloc(sizeof(struct frame_entry));
+  // nobody else can reach a free frame, so there is no need to take
+  // its lock here
   entry->t = thread_current();
-  entry->va_ptr = va_ptr;
-  entry->pinned = false;
   entry->spte = NULL;
+  entry->share = NULL;
+  entry->pinned = true;
+  // only zero synchronously if the idle thread hasn't got to it
+  if ((flags & PAL_ZERO) && !entry->zeroed)
+    memset (entry->va_ptr, 0, PGSIZE);
+  entry->zeroed = false;
 
-  // add the entry to the frame table at the index of the PFN
-  lock_acquire (&frame_lock);
-  frame_table[pfn-625] = entry; // normalize so that indexing starts at 0
-  lock_release (&frame_lock);
-  lock_release (&alloc_lock);
+  // let the page cleaner know if we're running low on free frames
+  swap_check_watermark ();
+  return entry->va_ptr;
+}
 
-  return va_ptr;
+/* Makes the frame holding KPAGE a candidate for eviction again. */
+void
+frame_unpin (void* kpage)
+{
+  struct frame_entry* entry = frame_lookup (kpage);
+  if (entry != NULL)
+    entry->pinned = false;
+}
+
+/* Detaches the frame holding KPAGE from whatever page used it and puts
+   it back on the free list. Called by palloc_free_page() for user
+   frames. */
+void
+frame_free (void* kpage)
+{
+  struct frame_entry* entry = frame_lookup (kpage);
+  enum intr_level old_level;
+
+  ASSERT (entry != NULL);
+  entry->t = NULL;
+  entry->spte = NULL;
+  entry->share = NULL;
+  entry->pinned = false;
+
+  old_level = intr_disable ();
+  entry->next_free = free_list;
+  free_list = entry;
+  free_cnt++;
+  intr_set_level (old_level);
+}
+
+/* Zeroes one free frame for a later zero-fill fault, moving it to the
+   zero list. Called by the idle thread, so it never blocks; the memset
+   runs with interrupts on, with the frame on neither list. Returns
+   false if there was no frame left to zero, or the reserve of zeroed
+   frames is full. */
+bool
+frame_zero_idle (void)
+{
+  struct frame_entry* entry;
+  enum intr_level old_level;
+
+  if (frame_table == NULL)
+    return false;
+  old_level = intr_disable ();
+  entry = zero_cnt < zero_target ? pop_free (&free_list) : NULL;
+  intr_set_level (old_level);
+  if (entry == NULL)
+    return false;
+
+  memset (entry->va_ptr, 0, PGSIZE);
+
+  old_level = intr_disable ();
+  entry->zeroed = true;
+  entry->next_free = zero_list;
+  zero_list = entry;
+  zero_cnt++;
+  free_cnt++;
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Takes the first frame off LIST, which is free_list or zero_list.
+   Interrupts must be off. */
+static struct frame_entry*
+pop_free (struct frame_entry** list)
+{
+  struct frame_entry* entry = *list;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (entry == NULL)
+    return NULL;
+  *list = entry->next_free;
+  free_cnt--;
+  if (list == &zero_list)
+    zero_cnt--;
+  return entry;
+}
+
+/* Returns the number of free frames. */
+size_t
+frame_free_cnt (void)
+{
+  return free_cnt;
 }
@@ -1,24 +1,47 @@
 #ifndef FRAME_H
 #define FRAME_H
 
+#include <list.h>
+#include <stdint.h>
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "vm/page.h"
 
-// struct that holds information about entries in the frame table
+struct shared_page;
+
+// struct that holds information about entries in the frame table.
+// there is one for every user frame, for the life of the kernel
 struct frame_entry
   {
     struct thread* t;
     void* va_ptr; // the kernel VA associated with this frame
+    struct frame_entry* next_free; // next frame on the free list, if this one is free
     struct page_table_elem* spte;
     bool pinned;
+    bool zeroed; // free and known to hold only zeroes, see frame_zero_idle()
+    int pin_cnt; // # of system calls doing I/O on this frame, see page_pin()
+    struct lock lock; // held while this frame is being evicted or filled
+    struct shared_page* share; // if not NULL, the shared page in this frame; SPTE and T are then NULL
+
+    // replacement policy state, see vm/evict.h
+    struct list_elem policy_elem; // position in the policy's lists
+    int policy_list;              // which of those lists, 0 if none
+    uint8_t age;                  // aging counter
+    int64_t last_use;             // tick of the last observed reference
   };
 
-struct frame_entry** frame_table;
+struct frame_entry* frame_table; // user_pgs entries, indexed by frame number within the user pool
 int user_pgs;
 
-struct lock alloc_lock;
-struct lock frame_lock;
+struct lock frame_lock; // protects the replacement policy state
 
+void frame_init (void);
 void * allocate_page (enum palloc_flags flags);
+void * try_allocate_page (enum palloc_flags flags);
+struct frame_entry* frame_lookup (void* kpage);
+void frame_unpin (void* kpage);
+void frame_free (void* kpage);
+size_t frame_free_cnt (void);
+bool frame_zero_idle (void);
 
 #endif
@@ -0,0 +1,143 @@
+#include "vm/ksm.h"
+#include <debug.h>
+#include <hash.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/frame.h"
+#include "vm/share.h"
+#include "vm/vmstat.h"
+
+/* Same-page merging. A low-priority kernel thread walks the frame
+   table a batch at a time, hashing the contents of resident private
+   pages of writable data, and merges pages with the same contents into
+   one frame shared copy-on-write, just as fork() shares them. A page
+   is only merged once its hash has stayed the same for a whole pass
+   over the frame table, so pages that are being written to keep their
+   own frames. Pages found in one pass are forgotten at the start of
+   the next. */
+
+#define KSM_BATCH 64                 /* Frames looked at per wakeup. */
+#define KSM_SLEEP (TIMER_FREQ / 10)  /* Ticks between batches. */
+
+/* A page seen in the current pass, in an open-addressed table. */
+struct ksm_entry
+  {
+    unsigned hash;               // hash of the contents
+    struct frame_entry* frame;   // frame that held them, NULL if unused
+  };
+
+static struct ksm_entry* table;
+static size_t table_size;        // a power of 2, at least twice user_pgs
+static unsigned* last_hash;      // each frame's hash in the previous pass
+static int hand;                 // next frame to look at
+
+static void ksmd (void* aux);
+static void scan_frame (struct frame_entry* frame);
+static bool lock_candidate (struct frame_entry* frame);
+
+/* Starts the merging thread. */
+void
+ksm_init (void)
+{
+  for (table_size = 1; table_size < 2 * (size_t) user_pgs; table_size *= 2)
+    continue;
+  table = calloc (table_size, sizeof *table);
+  last_hash = calloc (user_pgs, sizeof *last_hash);
+  if (table == NULL || last_hash == NULL)
+    PANIC ("ksm_init: cannot allocate tables");
+  thread_create ("ksmd", PRI_MIN, ksmd, NULL);
+}
+
+static void
+ksmd (void* aux UNUSED)
+{
+  for (;;)
+  {
+    int i;
+
+    timer_sleep (KSM_SLEEP);
+    for (i = 0; i < KSM_BATCH && i < user_pgs; i++)
+    {
+      scan_frame (&frame_table[hand]);
+      if (++hand == user_pgs)
+      {
+        hand = 0;
+        memset (table, 0, table_size * sizeof *table);
+      }
+    }
+  }
+}
+
+/* Looks for a page with the same contents as FRAME's among those seen
+   in this pass, and merges the two if there is one. Otherwise
+   remembers FRAME's. */
+static void
+scan_frame (struct frame_entry* frame)
+{
+  int idx = frame - frame_table;
+  struct ksm_entry* e;
+  unsigned hash;
+  bool stable;
+
+  if (!lock_candidate (frame))
+    return;
+  hash = hash_bytes (frame->va_ptr, PGSIZE);
+  stable = hash == last_hash[idx];
+  last_hash[idx] = hash;
+
+  // a private page has to have held still for a pass before it is
+  // merged or remembered. a shared one can't change
+  if (frame->spte != NULL && !stable)
+  {
+    lock_release (&frame->lock);
+    return;
+  }
+
+  for (e = &table[hash & (table_size - 1)]; e->frame != NULL;
+       e = e + 1 < table + table_size ? e + 1 : table)
+  {
+    struct frame_entry* target = e->frame;
+    bool merged;
+
+    if (e->hash != hash || frame->spte == NULL || target == frame
+        || !lock_candidate (target))
+      continue;
+    merged = share_merge (target, frame);
+    lock_release (&target->lock);
+    if (merged)
+    {
+      vmstat_add (ksm_merge_events, 1);
+      lock_release (&frame->lock);
+      palloc_free_page (frame->va_ptr);
+      return;
+    }
+  }
+  e->hash = hash;
+  e->frame = frame;
+  lock_release (&frame->lock);
+}
+
+/* Locks FRAME and returns true if it holds a resident private page of
+   writable data or an anonymous shared page. Never waits for the
+   lock. */
+static bool
+lock_candidate (struct frame_entry* frame)
+{
+  struct page_table_elem* spte;
+  bool ok;
+
+  if (frame->pinned || frame->pin_cnt > 0 || !lock_try_acquire (&frame->lock))
+    return false;
+  spte = frame->spte;
+  ok = !frame->pinned && frame->pin_cnt == 0
+       && ((spte != NULL && spte->writable && !spte->mmapped)
+           || (frame->share != NULL && frame->share->inode == NULL));
+  if (!ok)
+    lock_release (&frame->lock);
+  return ok;
+}
@@ -0,0 +1,6 @@
+#ifndef KSM_H
+#define KSM_H
+
+void ksm_init (void);
+
+#endif
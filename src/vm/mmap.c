@@ -0,0 +1,234 @@
+#include "vm/mmap.h"
+#include <round.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/evict.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/region.h"
+#include "vm/swap.h"
+
+/* Returns the file open as FD in the current thread, or NULL. */
+static struct file*
+lookup_fd (int fd)
+{
+  struct thread* cur = thread_current();
+  struct list_elem* e;
+
+  for (e = list_begin (&cur->fd_list); e != list_end (&cur->fd_list);
+       e = list_next (e))
+  {
+    struct fd_elem* entry = list_entry (e, struct fd_elem, elem);
+    if (entry->fd == fd)
+      return entry->file;
+  }
+  return NULL;
+}
+
+/* Maps the file open as FD at ADDR. Returns the new mapping's id, or -1
+   if FD isn't an open file, the file is empty, ADDR isn't page
+   aligned, or the mapping would overlap a page the process already
+   has. Nothing is read until the pages are touched. */
+int
+mmap_map (int fd, void* addr)
+{
+  struct thread* cur = thread_current();
+  struct file* file;
+  struct mmap_elem* m;
+  off_t length;
+  int i;
+
+  if (addr == NULL || pg_ofs (addr) != 0)
+    return -1;
+  file = lookup_fd (fd);
+  if (file == NULL)
+    return -1;
+
+  lock_acquire (&file_lock);
+  length = file_length (file);
+  lock_release (&file_lock);
+  if (length == 0)
+    return -1;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return -1;
+  m->addr = addr;
+  m->page_cnt = DIV_ROUND_UP (length, PGSIZE);
+  for (i = 0; i < m->page_cnt; i++)
+  {
+    void* upage = addr + i * PGSIZE;
+    if (!is_user_vaddr (upage) || page_in_spt (upage))
+    {
+      free (m);
+      return -1;
+    }
+  }
+
+  // the mapping outlives the descriptor, so it gets its own handle
+  lock_acquire (&file_lock);
+  m->file = file_reopen (file);
+  lock_release (&file_lock);
+  if (m->file == NULL)
+  {
+    free (m);
+    return -1;
+  }
+
+  // the pages themselves are added to the SPT as they are touched
+  m->region = region_add (addr, m->page_cnt, m->file, 0, length, true, true);
+  if (m->region == NULL)
+  {
+    lock_acquire (&file_lock);
+    file_close (m->file);
+    lock_release (&file_lock);
+    free (m);
+    return -1;
+  }
+
+  m->mapid = cur->next_mapid++;
+  list_push_back (&cur->mmap_list, &m->elem);
+  return m->mapid;
+}
+
+/* Writes PAGE, ENTRY's contents, back to the mapped file. */
+static void
+write_back (struct page_table_elem* entry, const void* page)
+{
+  // we may be exiting in the middle of a file system call
+  bool acquired_lock = !lock_held_by_current_thread (&file_lock);
+  if (acquired_lock)
+    lock_acquire (&file_lock);
+  file_write_at (entry->file, page, entry->page_read_bytes, entry->ofs);
+  if (acquired_lock)
+    lock_release (&file_lock);
+}
+
+/* Removes ENTRY, a mapped page of the current thread, writing it back
+   to the file first if it was modified. A mapped page only gets a swap
+   slot by being evicted while dirty, so a page with a slot counts as
+   modified even if it has been read back in and not written since. */
+static void
+unmap_page (struct page_table_elem* entry)
+{
+  struct thread* cur = thread_current();
+  struct frame_entry* frame;
+
+  // if the page is being evicted, let that finish first
+  for (;;)
+  {
+    frame = entry->frame_ptr;
+    if (frame == NULL)
+      break;
+    lock_acquire (&frame->lock);
+    if (entry->frame_ptr == frame)
+      break;
+    lock_release (&frame->lock);
+  }
+
+  if (frame != NULL)
+  {
+    if (entry->swap_elem != NULL || evict_is_dirty (frame))
+      write_back (entry, frame->va_ptr);
+    evict_release (frame);
+    pagedir_clear_page (cur->pagedir, entry->addr);
+    frame->spte = NULL;
+    entry->frame_ptr = NULL;
+    lock_release (&frame->lock);
+    palloc_free_page (frame->va_ptr);
+  }
+  else if (entry->swapped)
+  {
+    // only the copy in swap is up to date
+    void* kpage = palloc_get_page (0);
+    if (kpage != NULL)
+    {
+      swap_read_page (entry->swap_elem->swap_location, kpage);
+      write_back (entry, kpage);
+      palloc_free_page (kpage);
+    }
+  }
+
+  if (entry->swap_elem != NULL)
+  {
+    lock_acquire (&cur->spt_lock);
+    list_remove (&entry->swap_elem->elem);
+    lock_release (&cur->spt_lock);
+    swap_free_slot (entry->swap_elem->swap_location);
+    free (entry->swap_elem);
+  }
+
+  lock_acquire (&cur->spt_lock);
+  hash_delete (&cur->s_page_table, &entry->elem);
+  lock_release (&cur->spt_lock);
+  free (entry);
+}
+
+/* Removes the pages of M, which is not on the mmap_list, closes its
+   file and frees it. Only pages that were touched have SPT entries to
+   remove. */
+static void
+unmap (struct mmap_elem* m)
+{
+  struct thread* cur = thread_current();
+  int i;
+
+  for (i = 0; i < m->page_cnt; i++)
+  {
+    struct page_table_elem p;
+    struct hash_elem* h;
+
+    p.page_no = pg_no (m->addr + i * PGSIZE);
+    lock_acquire (&cur->spt_lock);
+    h = hash_find (&cur->s_page_table, &p.elem);
+    lock_release (&cur->spt_lock);
+    if (h != NULL)
+      unmap_page (hash_entry (h, struct page_table_elem, elem));
+  }
+  region_remove (m->region);
+
+  bool acquired_lock = !lock_held_by_current_thread (&file_lock);
+  if (acquired_lock)
+    lock_acquire (&file_lock);
+  file_close (m->file);
+  if (acquired_lock)
+    lock_release (&file_lock);
+  free (m);
+}
+
+/* Removes mapping MAPID of the current thread, writing its modified
+   pages back to the file. Does nothing if there is no such mapping. */
+void
+mmap_unmap (int mapid)
+{
+  struct thread* cur = thread_current();
+  struct list_elem* e;
+
+  for (e = list_begin (&cur->mmap_list); e != list_end (&cur->mmap_list);
+       e = list_next (e))
+  {
+    struct mmap_elem* m = list_entry (e, struct mmap_elem, elem);
+    if (m->mapid == mapid)
+    {
+      list_remove (e);
+      unmap (m);
+      return;
+    }
+  }
+}
+
+/* Removes all of the current thread's mappings. Called at exit, while
+   the page directory still exists. */
+void
+mmap_unmap_all (void)
+{
+  struct thread* cur = thread_current();
+
+  while (!list_empty (&cur->mmap_list))
+    unmap (list_entry (list_pop_front (&cur->mmap_list), struct mmap_elem, elem));
+}
@@ -0,0 +1,25 @@
+#ifndef MMAP_H
+#define MMAP_H
+
+#include <list.h>
+#include "filesys/file.h"
+#include "vm/region.h"
+
+/* A file mapped into a process's address space by mmap(). Its pages
+   are a region, read lazily from FILE like executable pages; this
+   only remembers where they are so munmap() can find them. */
+struct mmap_elem
+  {
+    struct list_elem elem;  // element in the owner's mmap_list
+    int mapid;              // the mapping's id, as returned by mmap()
+    struct file* file;      // the mapping's own handle on the file
+    void* addr;             // first page of the mapping
+    int page_cnt;           // # of pages in the mapping
+    struct vm_region* region; // the mapping's pages
+  };
+
+int mmap_map (int fd, void* addr);
+void mmap_unmap (int mapid);
+void mmap_unmap_all (void);
+
+#endif
@@ -2,18 +2,50 @@
 
 #include "vm/page.h"
 #include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "userprog/exception.h"
+#include "userprog/pagedir.h"
+#include "vm/evict.h"
 #include "vm/frame.h"
+#include "vm/prepage.h"
+#include "vm/region.h"
+#include "vm/share.h"
 #include "vm/swap.h"
+#include "vm/vmstat.h"
 
 
+/* One page of zeroes, mapped read-only in place of every zero-fill page
+   that has been read but not yet written. */
+static void* zero_page;
+
+/* Pages in the window fault_around() maps around a fault on a
+   file-backed page. 1 turns it off. */
+static size_t fault_around_pages;
+
+static void load_page (struct page_table_elem* entry, bool write);
+static bool read_file_page (struct page_table_elem* entry, uint8_t* kpage);
+static void fault_around (struct page_table_elem* entry);
+
+/* Allocates the zero page, and sets the fault-around window to
+   FAULT_AROUND pages. */
+void
+page_init (size_t fault_around)
+{
+  zero_page = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  fault_around_pages = fault_around;
+}
+
 /* Adds a page to the current thread's stack. Checks whether adding a page will
-   make the thread's stack too big, allocates a new page for it, sets that page
-   to zeroes, installs the page in the thread's page directory, and adds it to
-   the current thread's SPT. Called in syscall.c by check_address() and in
-   the page fault handler.
+   make the thread's stack too big, adds a zero-fill entry for it to the
+   current thread's SPT, and brings it in like any other page. Called by
+   the page fault handler, for user faults and for system calls touching
+   user memory.
 */
 void add_stack_page (struct intr_frame *f, void* addr)
 {
@@ -27,82 +59,124 @@ void add_stack_page (struct intr_frame *f, void* addr)
     thread_exit();
   }
 
-  // allocate the new page for the stack
-  uint8_t *kpage = allocate_page (PAL_ZERO);
-
-  if (kpage == NULL)
-  {
-    lock_acquire(&cur->element->lock);
-    cur->element->exit_status = -1;
-    lock_release(&cur->element->lock);
-    thread_exit();
-  }
-
-  // find the frame table entry associated with the page
-  uintptr_t phys_ptr = vtop (kpage);
-  uintptr_t pfn = pg_no (phys_ptr);
-  lock_acquire (&frame_lock);
-  frame_table[pfn-625]->pinned = true;
-  lock_release (&frame_lock);
-
-  // set the page to 0
-  memset (kpage, 0, 4096);
-  // install our page in the page directory so that it is writable
-  if (!install_new_page (pg_round_down(addr), kpage, true))
-    {
-      palloc_free_page (kpage);
-      lock_acquire(&cur->element->lock);
-      cur->element->exit_status = -1;
-      lock_release(&cur->element->lock);
-      thread_exit();
-    }
-
   // add this page to the SPT
-  lock_acquire (&frame_lock);
-  lock_acquire (&cur->spt_lock);
   struct page_table_elem* entry = malloc(sizeof(struct page_table_elem));
   entry->t = cur;
+  entry->addr = pg_round_down(addr);
   entry->page_no = pg_no(addr);
+  entry->file = NULL;
+  entry->ofs = 0;
   entry->writable = true;
+  entry->mmapped = false;
   entry->swapped = false;
+  entry->swap_elem = NULL;
+  entry->shared = NULL;
+  entry->page_read_bytes = 0;
+  entry->page_zero_bytes = PGSIZE;
+  entry->frame_ptr = NULL;
 
-  struct hash_elem* h = hash_insert (&cur->s_page_table, &entry->elem);
+  lock_acquire (&cur->spt_lock);
+  hash_insert (&cur->s_page_table, &entry->elem);
   lock_release (&cur->spt_lock);
 
   cur->stack_pages++;
+  vmstat_add (stack_faults, 1);
 
-  // associate kpage's frame table entry with this SPTE
-  frame_table[pfn-625]->spte = entry;
-  entry->frame_ptr = frame_table[pfn-625];
-  frame_table[pfn-625]->pinned = false;
-  lock_release (&frame_lock);
+  load_page (entry, (f->error_code & PF_W) != 0);
 }
 
-/* Adds a new page from disk (not swap) based on an SPT entry. */
-void
-add_spt_page (struct intr_frame *f, void *addr)
+static void swap_readahead (struct page_table_elem* entry);
+
+/* Returns the current thread's SPT entry for the page containing ADDR,
+   or NULL if it has none yet. Unlike page_lookup(), never makes one. */
+static struct page_table_elem*
+spt_find (void* addr)
 {
-  struct hash_elem* e;
-  struct page_table_elem p;
   struct thread* cur = thread_current();
+  struct page_table_elem p;
+  struct hash_elem* e;
 
   p.page_no = pg_no (addr);
-  p.t = cur;
-
-  // find the associated SPTE
   lock_acquire (&cur->spt_lock);
   e = hash_find (&cur->s_page_table, &p.elem);
   lock_release (&cur->spt_lock);
-  if (e == NULL)
-  {
-    lock_acquire(&cur->element->lock);
-    cur->element->exit_status = -1;
-    lock_release(&cur->element->lock);
-    thread_exit();
-  }
+  return e != NULL ? hash_entry (e, struct page_table_elem, elem) : NULL;
+}
+
+/* Returns the current thread's SPT entry for the page containing
+   ADDR. A page of a region that hasn't been touched yet has no entry,
+   so one is made for it from the region here. Returns NULL if ADDR is
+   not in any page the process has, or if out of memory. */
+struct page_table_elem*
+page_lookup (void* addr)
+{
+  struct thread* cur = thread_current();
+  struct page_table_elem* found = spt_find (addr);
+  struct vm_region* r;
+  size_t offset;
+
+  if (found != NULL)
+    return found;
+
+  r = region_find (cur, addr);
+  if (r == NULL)
+    return NULL;
+  struct page_table_elem* entry = malloc(sizeof(struct page_table_elem));
+  if (entry == NULL)
+    return NULL;
+  offset = (uint8_t*) pg_round_down (addr) - r->start;
+  entry->t = cur;
+  entry->addr = pg_round_down (addr);
+  entry->page_no = pg_no (addr);
+  entry->file = r->file;
+  entry->ofs = r->ofs + offset;
+  entry->page_read_bytes = r->read_bytes <= offset ? 0
+                           : r->read_bytes - offset < PGSIZE ? r->read_bytes - offset
+                           : PGSIZE;
+  entry->page_zero_bytes = PGSIZE - entry->page_read_bytes;
+  entry->writable = r->writable;
+  entry->mmapped = r->mmapped;
+  entry->swapped = false;
+  entry->swap_elem = NULL;
+  entry->frame_ptr = NULL;
+  // read-only pages are the same in every process running this
+  // executable, so they can all use one frame
+  entry->shared = r->writable || r->mmapped ? NULL
+                  : share_get (r->file, entry->ofs, entry->page_read_bytes);
+
   lock_acquire (&cur->spt_lock);
-  struct page_table_elem* entry = hash_entry(e, struct page_table_elem, elem);
+  hash_insert (&cur->s_page_table, &entry->elem);
   lock_release (&cur->spt_lock);
+  return entry;
+}
+
+/* If ENTRY's frame is being evicted right now, waits for the eviction
+   to finish. Returns true if ENTRY turned out to still be resident,
+   in which case there is nothing to load. */
+static bool
+wait_for_eviction (struct page_table_elem* entry)
+{
+  struct frame_entry* frame = entry->frame_ptr;
+  bool resident;
+
+  if (frame == NULL)
+    return false;
+  // the evicting thread holds the frame lock until the page's
+  // contents are safely on disk and frame_ptr has been cleared
+  lock_acquire (&frame->lock);
+  resident = entry->frame_ptr == frame;
+  lock_release (&frame->lock);
+  return resident;
+}
+
+/* Adds a new page from disk (not swap) based on an SPT entry. */
+void
+add_spt_page (struct intr_frame *f, void *addr)
+{
+  struct thread* cur = thread_current();
+
+  // find the associated SPTE
+  struct page_table_elem* entry = page_lookup (addr);
   if (entry == NULL)
   {
     lock_acquire(&cur->element->lock);
@@ -111,7 +185,55 @@ add_spt_page (struct intr_frame *f, void *addr)
     thread_exit();
   }
 
-  uint8_t *kpage = allocate_page (PAL_ZERO);
+  prepage_record (entry);
+  load_page (entry, (f->error_code & PF_W) != 0);
+}
+
+/* Brings in ENTRY's page for a fault that was a write if WRITE is
+   true. */
+static void
+load_page (struct page_table_elem* entry, bool write)
+{
+  struct thread* cur = thread_current();
+
+  if (wait_for_eviction (entry))
+  {
+    vmstat_add (minor_faults, 1);
+    return;
+  }
+
+  // read-only text may already be resident for another process
+  if (entry->shared != NULL)
+  {
+    share_fault (entry);
+    fault_around (entry);
+    return;
+  }
+
+  // a page that has never held anything but zeroes can be read from
+  // the zero page. the first write faults again and gets a frame
+  if (!write && !entry->swapped && entry->page_read_bytes == 0)
+  {
+    vmstat_add (minor_faults, 1);
+    if (!install_new_page (entry->addr, zero_page, false))
+    {
+      lock_acquire(&cur->element->lock);
+      cur->element->exit_status = -1;
+      lock_release(&cur->element->lock);
+      thread_exit();
+    }
+    return;
+  }
+
+  // the frame comes back pinned so that it can't be evicted until
+  // we are done with it. only a page with nothing to read needs it
+  // zeroed, preferably ahead of time by the idle thread
+  bool zero_fill = !entry->swapped && entry->page_read_bytes == 0;
+  if (zero_fill)
+    vmstat_add (minor_faults, 1);
+  else
+    vmstat_add (major_faults, 1);
+  uint8_t *kpage = allocate_page (zero_fill ? PAL_ZERO : 0);
 
   if (kpage == NULL)
   {
@@ -120,67 +242,27 @@ add_spt_page (struct intr_frame *f, void *addr)
     lock_release(&cur->element->lock);
     thread_exit();
   }
+  struct frame_entry* frame = frame_lookup (kpage);
 
-  // pin the frame that we are going to put the new page into
-  // so that it can't be evicted until we are done with it
-  uintptr_t phys_ptr = vtop (kpage);
-  uintptr_t pfn = pg_no (phys_ptr);
-  lock_acquire (&frame_lock);
-  frame_table[pfn-625]->pinned = true;
-  lock_release (&frame_lock);
-
-  if (entry->swapped == true)
+  bool swapped = entry->swapped;
+  if (swapped)
   {
     // if this entry was swapped out, we need to swap it back from the swap device
     swap_in (kpage, entry);
   }
   else
   {
-    // associate kpage's frame table entry with this SPTE
-    lock_acquire (&frame_lock);
-    lock_acquire (&cur->spt_lock);
-    frame_table[pfn-625]->spte = entry;
-    entry->frame_ptr = frame_table[pfn-625];
-    lock_release (&cur->spt_lock);
-    lock_release(&frame_lock);
-
     // we should only open the file if we actually need to read bytes from it
-    if (entry->page_read_bytes > 0)
+    if (entry->page_read_bytes > 0 && !read_file_page (entry, kpage))
     {
-      // the thread that page faulted might have faulted while it held the file lock,
-      // so we only need to acquire it if we don't already have it
-      bool acquired_lock = false;
-      if (!lock_held_by_current_thread(&file_lock))
-      {
-        acquired_lock = true;
-        lock_acquire(&file_lock);
-      }
-      lock_acquire(&swap_lock);
-      lock_acquire(&cur->spt_lock);
-      struct file* file = filesys_open(entry->name);
-      lock_release(&cur->spt_lock);
-      file_seek (file, entry->pos + entry->ofs);
-      if (file_read (file, kpage, entry->page_read_bytes) != entry->page_read_bytes)
-        {
-          lock_release(&swap_lock);
-          if (acquired_lock == true)
-            lock_release(&file_lock);
-          palloc_free_page (kpage);
-          lock_acquire(&cur->element->lock);
-          cur->element->exit_status = -1;
-          lock_release(&cur->element->lock);
-          thread_exit();
-        }
-      file_close(file);
-    lock_release (&swap_lock);
-    if (acquired_lock == true)
-      lock_release(&file_lock);
+      palloc_free_page (kpage);
+      lock_acquire(&cur->element->lock);
+      cur->element->exit_status = -1;
+      lock_release(&cur->element->lock);
+      thread_exit();
     }
-    memset (kpage + entry->page_read_bytes, 0, entry->page_zero_bytes);
-
-    if (!entry->writable)
-      pagedir_set_dirty(cur->pagedir, kpage, false);
   }
+
   // install the page into the current thread's page directory
   if (!install_new_page (entry->addr, kpage, entry->writable))
     {
@@ -190,9 +272,375 @@ add_spt_page (struct intr_frame *f, void *addr)
       lock_release(&cur->element->lock);
       thread_exit();
     }
-  lock_acquire (&frame_lock);
-  frame_table[pfn-625]->pinned = false;
-  lock_release (&frame_lock);
+
+  // associate kpage's frame table entry with this SPTE and make it
+  // evictable again
+  frame->spte = entry;
+  entry->frame_ptr = frame;
+  evict_page_in (frame);
+  frame_unpin (kpage);
+
+  if (swapped)
+    swap_readahead (entry);
+  else if (entry->page_read_bytes > 0)
+    fault_around (entry);
+}
+
+/* Reads ENTRY's file data into KPAGE and zeroes the rest of it.
+   Returns false if the read comes up short. */
+static bool
+read_file_page (struct page_table_elem* entry, uint8_t* kpage)
+{
+  // the thread that page faulted might have faulted while it held the file lock,
+  // so we only need to acquire it if we don't already have it
+  bool acquired_lock = false;
+  bool ok;
+  if (!lock_held_by_current_thread(&file_lock))
+  {
+    acquired_lock = true;
+    lock_acquire(&file_lock);
+  }
+  // one positioned read from the handle load() kept open
+  ok = file_read_at (entry->file, kpage, entry->page_read_bytes, entry->ofs) == (off_t) entry->page_read_bytes;
+  if (acquired_lock == true)
+    lock_release(&file_lock);
+  memset (kpage + entry->page_read_bytes, 0, entry->page_zero_bytes);
+  return ok;
+}
+
+/* Maps the file-backed pages around ENTRY's, which was just read in,
+   that the process hasn't touched yet: programs and mapped files tend
+   to be read in order, and a page brought in now is a fault saved
+   later. The window is fault_around_pages pages, aligned, and shrinks
+   when free frames run low, so that this never evicts. */
+static void
+fault_around (struct page_table_elem* entry)
+{
+  uint8_t* start;
+  uint8_t* addr;
+  size_t window = fault_around_pages;
+
+  while (window > 1 && frame_free_cnt () < 2 * window)
+    window /= 2;
+  if (window <= 1)
+    return;
+
+  start = (uint8_t*) entry->addr - (entry->page_no % window) * PGSIZE;
+  for (addr = start; addr < start + window * PGSIZE; addr += PGSIZE)
+  {
+    struct page_table_elem* next;
+
+    if (addr == entry->addr || !is_user_vaddr (addr))
+      continue;
+    // a page the process hasn't touched only gets an SPT entry, and a
+    // reference to its shared page, if it is really about to be read
+    next = spt_find (addr);
+    if (next == NULL)
+    {
+      struct vm_region* r = region_find (thread_current (), addr);
+      if (r == NULL || r->file != entry->file
+          || r->read_bytes <= (size_t) (addr - r->start))
+        continue;
+      if (frame_free_cnt () == 0 || evict_at_hard_limit ())
+        break;
+      next = page_lookup (addr);
+      if (next == NULL)
+        break;
+    }
+    else if (next->file != entry->file)
+      continue;
+    if (!page_prefetch (addr))
+      break;
+    // a startup profile has to cover the pages that never fault
+    // because they came in here
+    prepage_record (next);
+  }
+}
+
+/* Brings in the page at user address UPAGE of the current process, if
+   it is a file-backed page that is neither resident nor swapped out
+   yet, without evicting anything. The page is mapped as not accessed,
+   so that it is among the first to go if it turns out not to be
+   needed. Returns false if there was no free frame, the process is at
+   its hard RSS limit, or the page couldn't be read; the caller should
+   stop prefetching. */
+bool
+page_prefetch (void* upage)
+{
+  struct thread* cur = thread_current();
+  struct page_table_elem* entry = page_lookup (upage);
+  struct frame_entry* frame;
+  uint8_t* kpage;
+
+  if (entry == NULL || entry->page_read_bytes == 0 || entry->swapped
+      || entry->frame_ptr != NULL
+      || pagedir_get_page (cur->pagedir, entry->addr) != NULL)
+    return true;
+
+  if (evict_at_hard_limit ())
+    return false;
+  if (entry->shared != NULL)
+  {
+    if (!share_prefetch (entry))
+      return false;
+    vmstat_add (prefetches, 1);
+    return true;
+  }
+
+  kpage = try_allocate_page (0);
+  if (kpage == NULL)
+    return false;
+  if (!read_file_page (entry, kpage)
+      || !install_new_page (entry->addr, kpage, entry->writable))
+  {
+    palloc_free_page (kpage);
+    return false;
+  }
+  pagedir_set_accessed (cur->pagedir, entry->addr, false);
+  vmstat_add (prefetches, 1);
+
+  frame = frame_lookup (kpage);
+  frame->spte = entry;
+  entry->frame_ptr = frame;
+  evict_page_in (frame);
+  frame_unpin (kpage);
+  return true;
+}
+
+/* Speculatively brings in the current thread's swapped-out pages whose
+   slots are next to ENTRY's, up to SWAP_READAHEAD on each side and only
+   while the run of our own pages continues. Since evictions of a
+   process fill its swap cluster in order, those are usually the pages
+   that were next to ENTRY in memory too, and the reads are sequential
+   on disk. Stops as soon as there is no free frame: read-ahead never
+   evicts. */
+static void
+swap_readahead (struct page_table_elem* entry)
+{
+  struct thread* cur = thread_current();
+  int slot = entry->swap_elem->swap_location;
+  int dir, k;
+
+  for (dir = -1; dir <= 1; dir += 2)
+    for (k = 1; k <= SWAP_READAHEAD; k++)
+    {
+      struct page_table_elem* next = swap_slot_owner (slot + dir * k, cur);
+      if (next == NULL || !next->swapped || next->frame_ptr != NULL)
+        break;
+
+      uint8_t* kpage = try_allocate_page (0);
+      if (kpage == NULL)
+        return;
+      swap_in (kpage, next);
+      if (!install_new_page (next->addr, kpage, next->writable))
+      {
+        next->swapped = true;
+        palloc_free_page (kpage);
+        break;
+      }
+      // it hasn't actually been used yet, so let it be the first to go
+      pagedir_set_accessed (cur->pagedir, next->addr, false);
+
+      struct frame_entry* frame = frame_lookup (kpage);
+      frame->spte = next;
+      next->frame_ptr = frame;
+      evict_page_in (frame);
+      frame_unpin (kpage);
+    }
+}
+
+/* Detaches every resident page of thread T from its frame so that the
+   clock stops considering them. Must run before T's page directory is
+   destroyed. Waits for any eviction of T's pages that is in flight.
+   Shared pages are unmapped here too, and their references dropped. */
+void
+page_release_frames (struct thread* t)
+{
+  struct hash_iterator i;
+
+  // only T itself changes its SPT's shape, and T is the caller, so the
+  // walk doesn't need spt_lock (which evictors take while holding a
+  // frame lock)
+  hash_first (&i, &t->s_page_table);
+  while (hash_next (&i))
+  {
+    struct page_table_elem* entry = hash_entry (hash_cur (&i), struct page_table_elem, elem);
+    struct frame_entry* frame = entry->frame_ptr;
+    // the zero page must not be freed with the page directory
+    if (frame == NULL && entry->shared == NULL
+        && pagedir_get_page (t->pagedir, entry->addr) == zero_page)
+      pagedir_clear_page (t->pagedir, entry->addr);
+    if (entry->shared != NULL)
+    {
+      share_release (entry);
+      continue;
+    }
+    if (frame == NULL)
+      continue;
+    lock_acquire (&frame->lock);
+    if (entry->frame_ptr == frame)
+    {
+      evict_release (frame);
+      frame->spte = NULL;
+      frame->t = NULL;
+      entry->frame_ptr = NULL;
+    }
+    lock_release (&frame->lock);
+    // the page may have been merged while we waited for the lock
+    if (entry->shared != NULL)
+      share_release (entry);
+  }
+}
+
+/* Fills the current thread's SPT, for a process that fork() is
+   creating, with a copy of PARENT's. PARENT is blocked until we are
+   done. Writable pages whose contents are in memory or in swap become
+   copy-on-write pages shared with the parent; file mappings are left
+   out; other pages are
+   described by a copy of the parent's entry that reads from FILE, the
+   child's handle on the executable. Returns false if out of memory. */
+bool
+page_fork (struct thread* parent, struct file* file)
+{
+  struct thread* cur = thread_current();
+  struct hash_iterator i;
+
+  // untouched pages are described by the regions alone
+  if (!region_fork (parent, file))
+    return false;
+
+  hash_first (&i, &parent->s_page_table);
+  while (hash_next (&i))
+  {
+    struct page_table_elem* p = hash_entry (hash_cur (&i), struct page_table_elem, elem);
+    struct page_table_elem* c;
+
+    // mappings are not inherited
+    if (p->mmapped)
+      continue;
+    if (p->writable && p->shared == NULL && !share_anon (p))
+      return false;
+    c = malloc(sizeof(struct page_table_elem));
+    if (c == NULL)
+      return false;
+    *c = *p;
+    c->t = cur;
+    // the child's own handle on the executable; stack pages have none
+    c->file = p->file != NULL ? file : NULL;
+    c->swapped = false;
+    c->swap_elem = NULL;
+    c->frame_ptr = NULL;
+    if (c->shared != NULL)
+      share_dup (c->shared);
+
+    lock_acquire (&cur->spt_lock);
+    hash_insert (&cur->s_page_table, &c->elem);
+    lock_release (&cur->spt_lock);
+  }
+  return true;
+}
+
+/* Handles a write to the present page at ADDR. Returns false if it is
+   neither a copy-on-write page nor mapped to the zero page, i.e. the
+   write really is not allowed. */
+bool
+page_write_fault (void *addr)
+{
+  struct thread* cur = thread_current();
+  struct page_table_elem* entry = page_lookup (addr);
+  struct frame_entry* frame;
+
+  if (entry == NULL || !entry->writable)
+    return false;
+  if (entry->shared != NULL)
+  {
+    share_cow (entry);
+    return true;
+  }
+  if (entry->frame_ptr == NULL && pagedir_get_page (cur->pagedir, entry->addr) == zero_page)
+  {
+    // first write to a zero-fill page: give it a frame of its own
+    pagedir_clear_page (cur->pagedir, entry->addr);
+    load_page (entry, true);
+    return true;
+  }
+  frame = entry->frame_ptr;
+  if (frame != NULL)
+  {
+    // the page is mapped read-only while the same-page merger compares
+    // it, under the frame lock. once that is done, it is either
+    // writable again or shared copy-on-write
+    lock_acquire (&frame->lock);
+    lock_release (&frame->lock);
+    if (entry->shared != NULL)
+      share_cow (entry);
+    return true;
+  }
+  return false;
+}
+
+/* Returns true if ADDR belongs to a page in the current thread's SPT
+   or to one of its regions. */
+bool
+page_in_spt (void *addr)
+{
+  struct thread* cur = thread_current();
+  struct page_table_elem p;
+  struct hash_elem* e;
+
+  p.page_no = pg_no (addr);
+  lock_acquire (&cur->spt_lock);
+  e = hash_find (&cur->s_page_table, &p.elem);
+  lock_release (&cur->spt_lock);
+  return e != NULL || region_find (cur, addr) != NULL;
+}
+
+/* Pins the frame that user page UPAGE of the current process is
+   mapped to, so that a system call can do I/O on it while holding
+   file_lock without faulting. Returns false if the page isn't resident
+   (it may have been evicted since it was faulted in), or if WRITE is
+   true and it is mapped read-only (it may have been merged with an
+   identical page since); the caller should fault it in again and
+   retry. */
+bool
+page_pin (void* upage, bool write)
+{
+  uint32_t* pd = thread_current ()->pagedir;
+  void* kpage = pagedir_get_page (pd, upage);
+  struct frame_entry* frame;
+  bool resident;
+
+  if (kpage == NULL || (write && !pagedir_is_writable (pd, upage)))
+    return false;
+  // the zero page is never evicted
+  frame = frame_lookup (kpage);
+  if (frame == NULL)
+    return true;
+
+  // the evictor unmaps the page while holding the frame lock, so if
+  // it is still mapped here it can't go until we unpin it
+  lock_acquire (&frame->lock);
+  resident = pagedir_get_page (pd, upage) == kpage
+             && (!write || pagedir_is_writable (pd, upage));
+  if (resident)
+    frame->pin_cnt++;
+  lock_release (&frame->lock);
+  return resident;
+}
+
+/* Undoes page_pin (UPAGE). */
+void
+page_unpin (void* upage)
+{
+  void* kpage = pagedir_get_page (thread_current ()->pagedir, upage);
+  struct frame_entry* frame = frame_lookup (kpage);
+
+  if (frame == NULL)
+    return;
+  lock_acquire (&frame->lock);
+  ASSERT (frame->pin_cnt > 0);
+  frame->pin_cnt--;
+  lock_release (&frame->lock);
 }
 
 /* Adds a mapping from user virtual address UPAGE to kernel
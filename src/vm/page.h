@@ -20,20 +20,30 @@ struct page_table_elem
     void* addr;             // virtual address of the associated page
     int page_no;            // page number
     struct thread* t;       // thread associated with this entry
-    struct file* file;      // is this used?
-    char** name;            // name of the file associated with this entry
+    struct file* file;      // the process's executable, which backs this page
     bool writable;          // keeps track of whether this page is writable
+    bool mmapped;           // part of a file mapping: written back to FILE on munmap or exit
     size_t page_read_bytes; // number of bytes to read into this page from the file
     size_t page_zero_bytes; // number of bytes to set to zero at the end of the page
-    int ofs;                // offset to read from file
-    int pos;                // position to read from file
+    int ofs;                // offset in file of this page's data
     bool swapped;           // keeps track of whether the page has been swapped out
     struct swap_table_elem* swap_elem; // swap element associated with this page if it has been swapped out
     struct frame_entry* frame_ptr; // pointer to the frame table entry associated with this entry
+    struct shared_page* shared;    // if not NULL, the page is read-only executable text shared with other processes
+    struct list_elem share_elem;   // element in the shared page's list of sharers
   };
 
+void page_init (size_t fault_around);
 void add_stack_page (struct intr_frame *f, void *addr);
 void add_spt_page (struct intr_frame *f, void *addr);
 bool install_new_page (void *upage, void *kpage, bool writable);
+void page_release_frames (struct thread* t);
+bool page_in_spt (void *addr);
+struct page_table_elem* page_lookup (void* addr);
+bool page_pin (void* upage, bool write);
+void page_unpin (void* upage);
+bool page_fork (struct thread* parent, struct file* file);
+bool page_write_fault (void *addr);
+bool page_prefetch (void* upage);
 
 #endif
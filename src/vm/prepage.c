@@ -0,0 +1,164 @@
+#include "vm/prepage.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "devices/block.h"
+#include "devices/timer.h"
+#include "filesys/directory.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+#define PREPAGE_MAGIC 0x50475046 // "FPGP"
+
+/* Header of a profile file. The page numbers follow it. */
+struct prepage_header
+  {
+    uint32_t magic;             // PREPAGE_MAGIC
+    uint32_t exe_length;        // length of the executable it is for
+    uint32_t cnt;               // number of pages
+  };
+
+/* Ticks after start-up during which faults are recorded, 0 to turn
+   profiles off. */
+static int prepage_ticks;
+
+/* Turns profiling on, recording faults for TICKS ticks after each
+   program starts, or off if TICKS is 0. */
+void
+prepage_init (int ticks)
+{
+  prepage_ticks = ticks;
+}
+
+/* Puts the name of the profile file for EXE in NAME. File names are
+   short, so the profile is named after the executable's inode rather
+   than its name. */
+static void
+profile_name (struct file* exe, char name[NAME_MAX + 1])
+{
+  snprintf (name, NAME_MAX + 1, "pf.%"PRDSNu,
+            inode_get_inumber (file_get_inode (exe)));
+}
+
+/* Called by load() with file_lock held, once EXE, the current
+   process's executable, is set up for demand paging. If EXE has a
+   profile, brings in the pages it lists, in address order, which is
+   also their order in the file. Otherwise starts recording one. */
+void
+prepage_exec (struct file* exe)
+{
+  struct thread* cur = thread_current ();
+  char name[NAME_MAX + 1];
+  struct prepage_header h;
+  uint32_t* pages;
+  struct file* profile;
+  bool ok;
+  size_t i;
+
+  if (prepage_ticks == 0)
+    return;
+
+  profile_name (exe, name);
+  profile = filesys_open (name);
+  if (profile == NULL)
+  {
+    cur->prepage = malloc (sizeof *cur->prepage);
+    if (cur->prepage != NULL)
+    {
+      cur->prepage->start = timer_ticks ();
+      cur->prepage->cnt = 0;
+    }
+    return;
+  }
+
+  // a profile for another file that had the same inode is harmless,
+  // since prefetching only touches pages the process has anyway, but
+  // not worth reading. the list is too big for the kernel stack
+  pages = malloc (PREPAGE_MAX * sizeof *pages);
+  ok = pages != NULL
+       && file_read (profile, &h, sizeof h) == sizeof h
+       && h.magic == PREPAGE_MAGIC
+       && h.exe_length == (uint32_t) file_length (exe)
+       && h.cnt <= PREPAGE_MAX
+       && file_read (profile, pages, h.cnt * sizeof *pages)
+          == (off_t) (h.cnt * sizeof *pages);
+  file_close (profile);
+
+  for (i = 0; ok && i < h.cnt; i++)
+  {
+    void* upage = (void*) (pages[i] << PGBITS);
+    if (!is_user_vaddr (upage) || !page_prefetch (upage))
+      break;
+  }
+  free (pages);
+}
+
+/* Notes that the current process used ENTRY's page, which it either
+   faulted on or got from fault_around() along with a fault, if it is
+   being profiled and the page comes from its executable. */
+void
+prepage_record (struct page_table_elem* entry)
+{
+  struct thread* cur = thread_current ();
+  struct prepage_log* log = cur->prepage;
+  size_t i;
+
+  if (log == NULL || entry->file != cur->exec_file || entry->mmapped
+      || entry->page_read_bytes == 0 || log->cnt == PREPAGE_MAX
+      || timer_elapsed (log->start) > prepage_ticks)
+    return;
+  for (i = 0; i < log->cnt; i++)
+    if (log->pages[i] == (uint32_t) entry->page_no)
+      return;
+  log->pages[log->cnt++] = entry->page_no;
+}
+
+static int
+compare_pages (const void* a_, const void* b_)
+{
+  const uint32_t* a = a_;
+  const uint32_t* b = b_;
+  return *a < *b ? -1 : *a > *b;
+}
+
+/* Called by process_exit() with file_lock held, while the executable
+   is still open. Saves the current process's profile, if it recorded
+   one and no other process saved one first. */
+void
+prepage_exit (void)
+{
+  struct thread* cur = thread_current ();
+  struct prepage_log* log = cur->prepage;
+  char name[NAME_MAX + 1];
+  struct prepage_header h;
+  struct file* profile;
+  off_t size;
+
+  if (log == NULL)
+    return;
+  cur->prepage = NULL;
+
+  if (log->cnt > 0 && cur->exec_file != NULL)
+  {
+    qsort (log->pages, log->cnt, sizeof *log->pages, compare_pages);
+    h.magic = PREPAGE_MAGIC;
+    h.exe_length = file_length (cur->exec_file);
+    h.cnt = log->cnt;
+    size = sizeof h + log->cnt * sizeof *log->pages;
+
+    profile_name (cur->exec_file, name);
+    if (filesys_create (name, size))
+    {
+      profile = filesys_open (name);
+      if (profile != NULL)
+      {
+        file_write (profile, &h, sizeof h);
+        file_write (profile, log->pages, log->cnt * sizeof *log->pages);
+        file_close (profile);
+      }
+    }
+  }
+  free (log);
+}
@@ -0,0 +1,30 @@
+#ifndef PREPAGE_H
+#define PREPAGE_H
+
+#include <stdint.h>
+#include "filesys/file.h"
+#include "vm/page.h"
+
+/* Startup profiles. The first run of an executable records which of
+   its pages it faults in during its first few ticks, along with those
+   fault_around() maps next to them, and saves the list next to it in
+   the file system when it exits. Later runs read the list in load()
+   and bring all of those pages in before the program starts, instead
+   of one fault at a time. */
+
+#define PREPAGE_MAX 128 // most pages recorded per executable
+
+/* Pages faulted in by a process that is being profiled. */
+struct prepage_log
+  {
+    int64_t start;              // tick when the process started
+    size_t cnt;                 // number of entries in PAGES
+    uint32_t pages[PREPAGE_MAX]; // user page numbers, in fault order
+  };
+
+void prepage_init (int ticks);
+void prepage_exec (struct file* exe);
+void prepage_record (struct page_table_elem* entry);
+void prepage_exit (void);
+
+#endif
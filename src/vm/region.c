@@ -0,0 +1,97 @@
+#include "vm/region.h"
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+
+/* Each process's regions are kept in a list sorted by address. A
+   process has a handful of them (its segments and mappings), so a
+   linear search is as fast as anything fancier. Only the owner changes
+   its list, and only the owner and, while the owner is blocked in
+   fork(), its child read it, so no lock is needed. */
+
+static bool
+region_less (const struct list_elem* a, const struct list_elem* b,
+             void* aux UNUSED)
+{
+  return list_entry (a, struct vm_region, elem)->start
+         < list_entry (b, struct vm_region, elem)->start;
+}
+
+/* Adds a region of PAGE_CNT pages at START to the current process.
+   The first READ_BYTES bytes come from FILE starting at OFS, the rest
+   are zero. Returns the region, or NULL if out of memory. */
+struct vm_region*
+region_add (void* start, size_t page_cnt, struct file* file, off_t ofs,
+            size_t read_bytes, bool writable, bool mmapped)
+{
+  struct vm_region* r = malloc (sizeof *r);
+
+  if (r == NULL)
+    return NULL;
+  r->start = start;
+  r->end = r->start + page_cnt * PGSIZE;
+  r->file = file;
+  r->ofs = ofs;
+  r->read_bytes = read_bytes;
+  r->writable = writable;
+  r->mmapped = mmapped;
+  list_insert_ordered (&thread_current ()->regions, &r->elem, region_less, NULL);
+  return r;
+}
+
+/* Returns the region of T that contains ADDR, or NULL. */
+struct vm_region*
+region_find (struct thread* t, const void* addr)
+{
+  struct list_elem* e;
+
+  for (e = list_begin (&t->regions); e != list_end (&t->regions);
+       e = list_next (e))
+  {
+    struct vm_region* r = list_entry (e, struct vm_region, elem);
+    if ((const uint8_t*) addr < r->start)
+      break;
+    if ((const uint8_t*) addr < r->end)
+      return r;
+  }
+  return NULL;
+}
+
+/* Removes R from the current process and frees it. The caller deals
+   with any SPT entries for its pages. */
+void
+region_remove (struct vm_region* r)
+{
+  list_remove (&r->elem);
+  free (r);
+}
+
+/* Frees all of the current process's regions. */
+void
+region_destroy (void)
+{
+  struct thread* cur = thread_current ();
+
+  while (!list_empty (&cur->regions))
+    free (list_entry (list_pop_front (&cur->regions), struct vm_region, elem));
+}
+
+/* Gives the current process, which fork() is creating, copies of
+   PARENT's executable regions, backed by FILE, the child's own handle
+   on the executable. File mappings are not inherited. Returns false
+   if out of memory. */
+bool
+region_fork (struct thread* parent, struct file* file)
+{
+  struct list_elem* e;
+
+  for (e = list_begin (&parent->regions); e != list_end (&parent->regions);
+       e = list_next (e))
+  {
+    struct vm_region* r = list_entry (e, struct vm_region, elem);
+    if (!r->mmapped
+        && region_add (r->start, (r->end - r->start) / PGSIZE, file, r->ofs,
+                       r->read_bytes, r->writable, false) == NULL)
+      return false;
+  }
+  return true;
+}
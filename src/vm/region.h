@@ -0,0 +1,35 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/file.h"
+#include "filesys/off_t.h"
+#include "threads/thread.h"
+
+/* A run of pages in a process's address space that are all backed the
+   same way: a loadable segment of the executable, or a file mapping.
+   Pages of a region get an SPT entry only once they are touched;
+   until then the region is all there is to say about them. */
+struct vm_region
+  {
+    struct list_elem elem;      // element in the owner's regions list, sorted by START
+    uint8_t* start;             // first page
+    uint8_t* end;               // one past the last page
+    struct file* file;          // backing file
+    off_t ofs;                  // offset in FILE of the data at START
+    size_t read_bytes;          // bytes of the region read from FILE; the rest is zero
+    bool writable;              // whether the process may write to the pages
+    bool mmapped;               // a file mapping rather than part of the executable
+  };
+
+struct vm_region* region_add (void* start, size_t page_cnt, struct file* file,
+                              off_t ofs, size_t read_bytes, bool writable,
+                              bool mmapped);
+struct vm_region* region_find (struct thread* t, const void* addr);
+void region_remove (struct vm_region* r);
+void region_destroy (void);
+bool region_fork (struct thread* parent, struct file* file);
+
+#endif
@@ -0,0 +1,617 @@
+#include "vm/share.h"
+#include <string.h>
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/evict.h"
+#include "vm/swap.h"
+#include "vm/vmstat.h"
+
+/* Lock order: a frame's lock, then share_lock. A thread holding
+   share_lock may only try-lock a frame. */
+
+static struct hash share_table;
+
+/* Outcome of load_shared(). */
+enum load_result
+  {
+    LOAD_OK,            /* Loaded and mapped. */
+    LOAD_RACED,         /* Another process loaded it first. */
+    LOAD_FAILED         /* Couldn't read or map it. */
+  };
+
+static enum load_result load_shared (struct page_table_elem* entry,
+                                     uint8_t* kpage);
+static bool make_anon (struct page_table_elem* entry, struct frame_entry* frame);
+
+static unsigned
+share_hash (const struct hash_elem* e, void* aux UNUSED)
+{
+  const struct shared_page* sp = hash_entry (e, struct shared_page, elem);
+  return hash_bytes (&sp->inode, sizeof sp->inode) ^ hash_int (sp->ofs);
+}
+
+static bool
+share_less (const struct hash_elem* a_, const struct hash_elem* b_,
+            void* aux UNUSED)
+{
+  const struct shared_page* a = hash_entry (a_, struct shared_page, elem);
+  const struct shared_page* b = hash_entry (b_, struct shared_page, elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  if (a->ofs != b->ofs)
+    return a->ofs < b->ofs;
+  return a->read_bytes < b->read_bytes;
+}
+
+void
+share_init (void)
+{
+  hash_init (&share_table, share_hash, share_less, NULL);
+  lock_init (&share_lock);
+}
+
+/* Returns the shared page for the READ_BYTES bytes at OFS in FILE,
+   creating it if no process has it yet, and takes a reference to it.
+   Returns NULL if out of memory, in which case the caller keeps the
+   page private. */
+struct shared_page*
+share_get (struct file* file, off_t ofs, size_t read_bytes)
+{
+  struct shared_page key;
+  struct shared_page* sp;
+  struct hash_elem* e;
+
+  key.inode = file_get_inode (file);
+  key.ofs = ofs;
+  key.read_bytes = read_bytes;
+
+  lock_acquire (&share_lock);
+  e = hash_find (&share_table, &key.elem);
+  if (e != NULL)
+    sp = hash_entry (e, struct shared_page, elem);
+  else
+  {
+    sp = malloc (sizeof *sp);
+    if (sp != NULL)
+    {
+      *sp = key;
+      sp->ref_cnt = 0;
+      sp->frame = NULL;
+      sp->swap_slot = BITMAP_ERROR;
+      list_init (&sp->sharers);
+      hash_insert (&share_table, &sp->elem);
+    }
+  }
+  if (sp != NULL)
+    sp->ref_cnt++;
+  lock_release (&share_lock);
+  return sp;
+}
+
+/* Takes another reference to SP. */
+void
+share_dup (struct shared_page* sp)
+{
+  lock_acquire (&share_lock);
+  sp->ref_cnt++;
+  lock_release (&share_lock);
+}
+
+/* Locks SP's frame, if it has one, and share_lock. The frame lock
+   comes first, so look, lock, and check that it is still the same
+   frame. Returns the frame. */
+static struct frame_entry*
+lock_frame (struct shared_page* sp)
+{
+  struct frame_entry* frame;
+
+  for (;;)
+  {
+    lock_acquire (&share_lock);
+    frame = sp->frame;
+    lock_release (&share_lock);
+    if (frame != NULL)
+      lock_acquire (&frame->lock);
+    lock_acquire (&share_lock);
+    if (sp->frame == frame)
+      return frame;
+    lock_release (&share_lock);
+    if (frame != NULL)
+      lock_release (&frame->lock);
+  }
+}
+
+static void
+kill_current (void)
+{
+  struct thread* cur = thread_current ();
+  lock_acquire (&cur->element->lock);
+  cur->element->exit_status = -1;
+  lock_release (&cur->element->lock);
+  thread_exit ();
+}
+
+/* Maps ENTRY's shared page into the current process, reading it from
+   the executable only if no other process has it resident. */
+void
+share_fault (struct page_table_elem* entry)
+{
+  struct shared_page* sp = entry->shared;
+  struct frame_entry* frame;
+  uint8_t* kpage;
+
+  for (;;)
+  {
+    lock_acquire (&share_lock);
+    frame = sp->frame;
+    if (frame == NULL)
+      break;
+    if (lock_try_acquire (&frame->lock))
+    {
+      // resident and not busy: just map it
+      bool ok = install_new_page (entry->addr, frame->va_ptr, false);
+      vmstat_add (minor_faults, 1);
+      if (ok)
+      {
+        list_push_back (&sp->sharers, &entry->share_elem);
+        entry->frame_ptr = frame;
+      }
+      lock_release (&share_lock);
+      lock_release (&frame->lock);
+      if (!ok)
+        kill_current ();
+      return;
+    }
+    // another process is filling or evicting it. wait for that to
+    // finish and look again
+    lock_release (&share_lock);
+    lock_acquire (&frame->lock);
+    lock_release (&frame->lock);
+  }
+  lock_release (&share_lock);
+
+  // not resident: load it ourselves. allocating may evict, which takes
+  // share_lock, so it happens before we publish the frame
+  kpage = allocate_page (0);
+  if (kpage == NULL)
+    kill_current ();
+  switch (load_shared (entry, kpage))
+  {
+    case LOAD_OK:
+      vmstat_add (major_faults, 1);
+      break;
+    case LOAD_RACED:
+      // someone else got there first; use theirs
+      share_fault (entry);
+      break;
+    case LOAD_FAILED:
+      kill_current ();
+  }
+}
+
+/* Like share_fault(), but for a page the current process hasn't
+   touched yet and may never touch: maps ENTRY's shared page only if
+   that takes neither waiting for a busy frame nor evicting. Returns
+   false if it couldn't, in which case ENTRY is left alone. */
+bool
+share_prefetch (struct page_table_elem* entry)
+{
+  struct shared_page* sp = entry->shared;
+  struct frame_entry* frame;
+  uint8_t* kpage;
+  bool ok;
+
+  lock_acquire (&share_lock);
+  frame = sp->frame;
+  if (frame != NULL)
+  {
+    if (!lock_try_acquire (&frame->lock))
+    {
+      lock_release (&share_lock);
+      return false;
+    }
+    ok = install_new_page (entry->addr, frame->va_ptr, false);
+    if (ok)
+    {
+      list_push_back (&sp->sharers, &entry->share_elem);
+      entry->frame_ptr = frame;
+      pagedir_set_accessed (entry->t->pagedir, entry->addr, false);
+    }
+    lock_release (&share_lock);
+    lock_release (&frame->lock);
+    return ok;
+  }
+  lock_release (&share_lock);
+
+  kpage = try_allocate_page (0);
+  if (kpage == NULL)
+    return false;
+  if (load_shared (entry, kpage) != LOAD_OK)
+    return false;
+  pagedir_set_accessed (entry->t->pagedir, entry->addr, false);
+  return true;
+}
+
+/* Reads ENTRY's shared page into KPAGE, a frame fresh from
+   allocate_page(), publishes it as the page's frame and maps it.
+   Frees KPAGE if another process published a frame first or if the
+   read fails. */
+static enum load_result
+load_shared (struct page_table_elem* entry, uint8_t* kpage)
+{
+  struct shared_page* sp = entry->shared;
+  struct frame_entry* frame = frame_lookup (kpage);
+
+  lock_acquire (&frame->lock);
+  lock_acquire (&share_lock);
+  if (sp->frame != NULL)
+  {
+    lock_release (&share_lock);
+    lock_release (&frame->lock);
+    palloc_free_page (kpage);
+    return LOAD_RACED;
+  }
+  // publish it. anyone else faulting on the page now waits for our
+  // frame lock
+  sp->frame = frame;
+  frame->share = sp;
+  frame->t = NULL;
+  lock_release (&share_lock);
+
+  bool ok = true;
+  if (sp->inode == NULL)
+    swap_read_page (sp->swap_slot, kpage);
+  else
+  {
+    if (sp->read_bytes > 0)
+    {
+      bool acquired_lock = !lock_held_by_current_thread (&file_lock);
+      if (acquired_lock)
+        lock_acquire (&file_lock);
+      ok = file_read_at (entry->file, kpage, sp->read_bytes, sp->ofs) == (off_t) sp->read_bytes;
+      if (acquired_lock)
+        lock_release (&file_lock);
+    }
+    memset (kpage + sp->read_bytes, 0, PGSIZE - sp->read_bytes);
+  }
+  ok = ok && install_new_page (entry->addr, kpage, false);
+
+  if (!ok)
+  {
+    lock_acquire (&share_lock);
+    sp->frame = NULL;
+    frame->share = NULL;
+    lock_release (&share_lock);
+    lock_release (&frame->lock);
+    palloc_free_page (kpage);
+    return LOAD_FAILED;
+  }
+
+  list_push_back (&sp->sharers, &entry->share_elem);
+  entry->frame_ptr = frame;
+  lock_release (&frame->lock);
+  evict_page_in (frame);
+  frame_unpin (kpage);
+  return LOAD_OK;
+}
+
+/* Unmaps the shared page in FRAME, which the caller has locked for
+   eviction, from every process that maps it. Text never needs writing
+   back: the next fault rereads it. An anonymous page is written to
+   swap the first time it is evicted, and since nobody can write to it
+   while it is shared, that copy stays good from then on. */
+void
+share_evict (struct frame_entry* frame)
+{
+  struct shared_page* sp = frame->share;
+
+  if (sp->inode == NULL && sp->swap_slot == BITMAP_ERROR)
+    sp->swap_slot = swap_write_page (frame->va_ptr);
+  else
+    vmstat_add (discards, 1);
+
+  lock_acquire (&share_lock);
+  while (!list_empty (&sp->sharers))
+  {
+    struct page_table_elem* spte = list_entry (list_pop_front (&sp->sharers),
+                                               struct page_table_elem, share_elem);
+    pagedir_clear_page (spte->t->pagedir, spte->addr);
+    spte->frame_ptr = NULL;
+  }
+  sp->frame = NULL;
+  frame->share = NULL;
+  lock_release (&share_lock);
+}
+
+/* Drops the current process's use of ENTRY's shared page: unmaps it if
+   it is mapped, so that pagedir_destroy() won't free a frame other
+   processes still use, and releases the reference. The last reference
+   frees the frame and the shared page. */
+void
+share_release (struct page_table_elem* entry)
+{
+  struct shared_page* sp = entry->shared;
+  struct frame_entry* frame = lock_frame (sp);
+  void* kpage = NULL;
+
+  if (entry->frame_ptr != NULL)
+  {
+    list_remove (&entry->share_elem);
+    pagedir_clear_page (entry->t->pagedir, entry->addr);
+    entry->frame_ptr = NULL;
+  }
+  entry->shared = NULL;
+  if (--sp->ref_cnt == 0)
+  {
+    if (sp->inode != NULL)
+      hash_delete (&share_table, &sp->elem);
+    if (frame != NULL)
+    {
+      frame->share = NULL;
+      kpage = frame->va_ptr;
+    }
+  }
+  else
+    sp = NULL;
+  lock_release (&share_lock);
+
+  if (kpage != NULL)
+    evict_release (frame);
+  if (frame != NULL)
+    lock_release (&frame->lock);
+  if (kpage != NULL)
+    palloc_free_page (kpage);
+  if (sp != NULL && sp->swap_slot != BITMAP_ERROR)
+    swap_free_slot (sp->swap_slot);
+  free (sp);
+}
+
+/* Turns ENTRY, a writable page of a process that is blocked in fork(),
+   into an anonymous shared page that only ENTRY refers to so far, if
+   its contents are in memory or in swap. A page that still comes from
+   the executable or is all zeroes is left alone, since a copy of its
+   SPTE describes it just as well. Returns false if out of memory. */
+bool
+share_anon (struct page_table_elem* entry)
+{
+  struct frame_entry* frame;
+  bool ok;
+
+  // if the page is being evicted, let that finish first
+  for (;;)
+  {
+    frame = entry->frame_ptr;
+    if (frame == NULL)
+      break;
+    lock_acquire (&frame->lock);
+    if (entry->frame_ptr == frame)
+      break;
+    lock_release (&frame->lock);
+  }
+  // the page may have been merged since the caller looked at it
+  ok = entry->shared != NULL || (frame == NULL && !entry->swapped)
+       || make_anon (entry, frame);
+  if (frame != NULL)
+    lock_release (&frame->lock);
+  return ok;
+}
+
+/* Does the work of share_anon() for ENTRY, whose frame, if it is
+   resident, is FRAME, which the caller has locked. */
+static bool
+make_anon (struct page_table_elem* entry, struct frame_entry* frame)
+{
+  struct thread* owner = entry->t;
+  struct shared_page* sp;
+  struct swap_table_elem* s;
+
+  sp = malloc (sizeof *sp);
+  if (sp == NULL)
+    return false;
+  sp->inode = NULL;
+  sp->ofs = 0;
+  sp->read_bytes = 0;
+  sp->ref_cnt = 1;
+  sp->frame = frame;
+  sp->swap_slot = BITMAP_ERROR;
+  list_init (&sp->sharers);
+
+  // the page's swap slot moves to the shared page if it still holds
+  // the page's contents, and is freed otherwise
+  s = entry->swap_elem;
+  if (s != NULL)
+  {
+    lock_acquire (&owner->spt_lock);
+    list_remove (&s->elem);
+    lock_release (&owner->spt_lock);
+    if (frame == NULL || !evict_is_dirty (frame))
+    {
+      sp->swap_slot = s->swap_location;
+      swap_set_owner (sp->swap_slot, NULL);
+    }
+    else
+      swap_free_slot (s->swap_location);
+    free (s);
+    entry->swap_elem = NULL;
+  }
+  entry->swapped = false;
+  entry->shared = sp;
+
+  if (frame != NULL)
+  {
+    // map it read-only, so that the next write faults
+    pagedir_clear_page (owner->pagedir, entry->addr);
+    pagedir_set_page (owner->pagedir, entry->addr, frame->va_ptr, false);
+    list_push_back (&sp->sharers, &entry->share_elem);
+    frame->share = sp;
+    frame->spte = NULL;
+    frame->t = NULL;
+    evict_rss_change (owner, -1);
+  }
+  return true;
+}
+
+/* Maps ENTRY's page, which is resident in FRAME, writable if WRITABLE
+   is true and read-only otherwise, keeping its accessed and dirty
+   bits. The owner may be running, so the bits are only read once the
+   page is unmapped, when no more writes can set them. */
+static void
+remap (struct page_table_elem* entry, struct frame_entry* frame, bool writable)
+{
+  uint32_t* pd = entry->t->pagedir;
+  bool accessed, dirty;
+
+  pagedir_clear_page (pd, entry->addr);
+  accessed = pagedir_is_accessed (pd, entry->addr);
+  dirty = pagedir_is_dirty (pd, entry->addr);
+  if (!pagedir_set_page (pd, entry->addr, frame->va_ptr, writable))
+    PANIC ("share: cannot remap page");
+  pagedir_set_accessed (pd, entry->addr, accessed);
+  pagedir_set_dirty (pd, entry->addr, dirty);
+}
+
+/* Merges the private page in FRAME into TARGET, which holds either
+   another private page or an anonymous shared page, if their contents
+   are the same. The page becomes a copy-on-write page shared with
+   TARGET's, as if they had been forked, and FRAME is left unused.
+   Both frames must be locked, resident and unpinned, and the owners
+   may be running: both pages are mapped read-only before they are
+   compared, and a write in the meantime waits in page_write_fault()
+   for FRAME's lock. Returns false, with nothing changed, if the pages
+   differ or if out of memory. */
+bool
+share_merge (struct frame_entry* target, struct frame_entry* frame)
+{
+  struct page_table_elem* entry = frame->spte;
+  struct page_table_elem* target_entry = target->spte;
+  struct thread* owner = entry->t;
+  struct shared_page* sp;
+  struct swap_table_elem* s;
+
+  ASSERT (entry != NULL && entry->writable && !entry->mmapped);
+  ASSERT (target_entry != NULL
+          || (target->share != NULL && target->share->inode == NULL));
+
+  remap (entry, frame, false);
+  if (target_entry != NULL)
+    remap (target_entry, target, false);
+  if (memcmp (target->va_ptr, frame->va_ptr, PGSIZE) != 0
+      || (target_entry != NULL && !make_anon (target_entry, target)))
+  {
+    remap (entry, frame, true);
+    if (target_entry != NULL)
+      remap (target_entry, target, true);
+    return false;
+  }
+  sp = target->share;
+
+  // the page's swap copy, if any, is of no more use
+  s = entry->swap_elem;
+  if (s != NULL)
+  {
+    lock_acquire (&owner->spt_lock);
+    list_remove (&s->elem);
+    lock_release (&owner->spt_lock);
+    swap_free_slot (s->swap_location);
+    free (s);
+    entry->swap_elem = NULL;
+  }
+  entry->swapped = false;
+
+  lock_acquire (&share_lock);
+  sp->ref_cnt++;
+  lock_release (&share_lock);
+  pagedir_clear_page (owner->pagedir, entry->addr);
+  if (!pagedir_set_page (owner->pagedir, entry->addr, target->va_ptr, false))
+    PANIC ("share_merge: cannot remap page");
+  list_push_back (&sp->sharers, &entry->share_elem);
+  entry->shared = sp;
+  entry->frame_ptr = target;
+
+  evict_release (frame);
+  frame->spte = NULL;
+  frame->t = NULL;
+  return true;
+}
+
+/* Handles a write by the current process to ENTRY's copy-on-write
+   page. The process gets a private, writable copy, or the frame itself
+   if no other process refers to the page any more. */
+void
+share_cow (struct page_table_elem* entry)
+{
+  struct shared_page* sp = entry->shared;
+  struct thread* cur = thread_current ();
+  struct frame_entry* frame;
+  uint8_t* kpage;
+  size_t slot;
+
+  // get the frame for the copy first: allocating may evict, which
+  // takes share_lock
+  kpage = allocate_page (0);
+  if (kpage == NULL)
+    kill_current ();
+
+  frame = lock_frame (sp);
+  if (frame != NULL)
+    vmstat_add (minor_faults, 1);
+  else
+    vmstat_add (major_faults, 1);
+  if (sp->ref_cnt == 1 && frame != NULL)
+  {
+    // the last one out keeps the frame
+    if (entry->frame_ptr != NULL)
+    {
+      list_remove (&entry->share_elem);
+      pagedir_clear_page (cur->pagedir, entry->addr);
+    }
+    frame->share = NULL;
+    frame->spte = entry;
+    frame->t = cur;
+    entry->frame_ptr = frame;
+    entry->shared = NULL;
+    lock_release (&share_lock);
+    evict_rss_change (cur, 1);
+
+    if (!install_new_page (entry->addr, frame->va_ptr, true))
+      PANIC ("share_cow: cannot remap page");
+    // the page is no longer on disk anywhere
+    pagedir_set_dirty (cur->pagedir, entry->addr, true);
+    lock_release (&frame->lock);
+    if (sp->swap_slot != BITMAP_ERROR)
+      swap_free_slot (sp->swap_slot);
+    free (sp);
+    palloc_free_page (kpage);
+    return;
+  }
+
+  // copy it. our reference keeps the swap slot alive while we read it
+  if (frame != NULL)
+    memcpy (kpage, frame->va_ptr, PGSIZE);
+  slot = sp->swap_slot;
+  lock_release (&share_lock);
+  if (frame != NULL)
+    lock_release (&frame->lock);
+  else
+    swap_read_page (slot, kpage);
+  share_release (entry);
+
+  if (!install_new_page (entry->addr, kpage, true))
+  {
+    palloc_free_page (kpage);
+    kill_current ();
+  }
+  // the copy only exists in memory, so it must be written out if evicted
+  pagedir_set_dirty (cur->pagedir, entry->addr, true);
+  frame = frame_lookup (kpage);
+  frame->spte = entry;
+  entry->frame_ptr = frame;
+  evict_page_in (frame);
+  frame_unpin (kpage);
+}
@@ -0,0 +1,53 @@
+#ifndef SHARE_H
+#define SHARE_H
+
+#include <bitmap.h>
+#include <hash.h>
+#include <list.h>
+#include "filesys/inode.h"
+#include "filesys/off_t.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+
+/* A page that several processes map read-only from one frame.
+
+   Executable text is shared by every process running the same
+   executable. It is keyed by the executable's inode and the page's
+   place in it, which is safe for as long as some process holds the
+   file open: the inode can't be reused before then, and the file
+   can't change because it is denied write.
+
+   Anonymous pages, with a null INODE, are writable pages that fork()
+   left shared copy-on-write between parent and child. They are not in
+   the share table, and when evicted they go to a swap slot of their
+   own. */
+struct shared_page
+  {
+    struct hash_elem elem;  // element in the share table
+    struct inode* inode;    // the executable, NULL for an anonymous page
+    off_t ofs;              // offset of the page's data in the executable
+    size_t read_bytes;      // bytes of the page that come from the file
+    int ref_cnt;            // # of SPTEs referring to this page, resident or not
+    struct frame_entry* frame; // the frame holding the page, NULL if not resident
+    size_t swap_slot;       // anonymous pages: the copy in swap, or BITMAP_ERROR
+
+    // reverse map: the SPTEs whose page directories map FRAME. Protected
+    // by FRAME's lock, since only a thread holding it may add or remove
+    // a mapping
+    struct list sharers;
+  };
+
+struct lock share_lock; // protects the share table and each shared_page's frame and ref_cnt
+
+void share_init (void);
+struct shared_page* share_get (struct file* file, off_t ofs, size_t read_bytes);
+void share_fault (struct page_table_elem* entry);
+bool share_prefetch (struct page_table_elem* entry);
+void share_evict (struct frame_entry* frame);
+void share_release (struct page_table_elem* entry);
+void share_dup (struct shared_page* sp);
+bool share_anon (struct page_table_elem* entry);
+void share_cow (struct page_table_elem* entry);
+bool share_merge (struct frame_entry* target, struct frame_entry* frame);
+
+#endif
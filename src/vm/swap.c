@@ -7,134 +7,555 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "devices/block.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 #include "threads/vaddr.h"
 #include "threads/thread.h"
+#include "vm/evict.h"
 #include "vm/frame.h"
+#include "vm/share.h"
+#include "vm/vmstat.h"
+#include "vm/zswap.h"
 #include "userprog/pagedir.h"
 #include "threads/palloc.h"
 #include <random.h>
 #include <string.h>
 
-void swap_init (void)
+/* Page cleaner: a kernel thread that evicts pages ahead of demand so
+   that the fault path usually finds a free frame waiting in the user
+   pool. It is woken when the pool drops below LOW_WATERMARK free pages
+   and works in batches until HIGH_WATERMARK pages are free again. */
+#define CLEANER_BATCH 8         /* Pages evicted between free-count checks. */
+#define CLEANER_BACKOFF 2       /* Ticks to wait when nothing is evictable. */
+static size_t low_watermark;
+static size_t high_watermark;
+static struct semaphore cleaner_sema;
+static bool cleaner_awake;      // protected by disabling interrupts
+
+static void page_cleaner (void *aux);
+static size_t clean_batch (size_t cnt);
+static void* evict (struct frame_entry* frame_ptr);
+
+/* The SPT entry whose page is stored in each swap slot, or NULL.
+   Protected by swap_lock. Used to find a page's neighbours on disk
+   for read-ahead. */
+static struct page_table_elem** slot_owner;
+
+/* Swap devices. The slots of all of them are numbered together, each
+   device's from BASE to BASE + SLOT_CNT - 1. Devices of higher
+   priority fill up first; clusters of slots are striped across devices
+   of equal priority, so that evictions by different threads can keep
+   several disks busy at once. */
+#define SWAP_MAX_DEVS 8
+
+struct swap_dev
+  {
+    struct block* block;
+    size_t base;        // first slot on this device
+    size_t slot_cnt;    // number of slots on this device
+    int prio;           // priority, higher first
+  };
+
+static struct swap_dev swap_devs[SWAP_MAX_DEVS]; // in descending order of priority
+static int swap_dev_cnt;
+static unsigned stripe; // rotates allocations among devices, protected by swap_lock
+
+static void add_dev (struct block* block, int prio);
+
+/* Sets up the swap devices named in DEVICES, a comma-separated list of
+   block device names each optionally followed by ":PRIORITY", or every
+   device of swap type if DEVICES is null, with a compressed pool of
+   ZSWAP_PAGES pages in front of them. Also starts the page cleaner,
+   which keeps between LOW and HIGH user frames free. A HIGH of 0
+   disables the cleaner. */
+void swap_init (char* devices, size_t low, size_t high, size_t zswap_pages)
 {
-  swap_block = block_get_role(BLOCK_SWAP); // get a pointer to the location of the swap disk
-  num_swap_slots = (block_size(swap_block)*BLOCK_SECTOR_SIZE) / PGSIZE; // get the number of swap slots on the swap disk
+  struct block* block;
+
+  if (devices != NULL)
+  {
+    char* name;
+    char* save_ptr;
+
+    for (name = strtok_r (devices, ",", &save_ptr); name != NULL;
+         name = strtok_r (NULL, ",", &save_ptr))
+    {
+      char* prio = strchr (name, ':');
+      if (prio != NULL)
+        *prio++ = '\0';
+      block = block_get_by_name (name);
+      if (block == NULL)
+        PANIC ("No such block device \"%s\"", name);
+      add_dev (block, prio != NULL ? atoi (prio) : 0);
+    }
+  }
+  else
+    for (block = block_first (); block != NULL; block = block_next (block))
+      if (block_type (block) == BLOCK_SWAP)
+        add_dev (block, 0);
+
   swap_slots = bitmap_create(num_swap_slots);
-  current_clock = 1;
+  slot_owner = calloc (num_swap_slots, sizeof *slot_owner);
+  if (swap_slots == NULL || slot_owner == NULL)
+    PANIC ("swap_init: cannot allocate swap table");
+  zswap_init (num_swap_slots, zswap_pages);
 
   lock_init (&swap_lock);
+
+  // never try to keep more than half of user memory free
+  if (high > (size_t) user_pgs / 2)
+    high = user_pgs / 2;
+  if (low > high)
+    low = high;
+  low_watermark = low;
+  high_watermark = high;
+  sema_init (&cleaner_sema, 0);
+  if (high_watermark > 0)
+    thread_create ("pgclean", PRI_DEFAULT, page_cleaner, NULL);
 }
 
-/* Finds a frame to evict and swaps it out, writing the contents of the
-   frame to swap space if necessary. Clears the frame and returns a pointer
-   to it so that a process can use it. */
-void* swap_out ()
+/* Adds BLOCK to the swap devices, with priority PRIO. */
+static void
+add_dev (struct block* block, int prio)
 {
-  lock_acquire (&swap_lock);
+  struct swap_dev* dev;
+
+  if (swap_dev_cnt == SWAP_MAX_DEVS)
+    PANIC ("swap_init: too many swap devices");
+  // keep the array sorted by priority, in the order given among equals
+  for (dev = &swap_devs[swap_dev_cnt]; dev > swap_devs && dev[-1].prio < prio; dev--)
+    dev[0] = dev[-1];
+  dev->block = block;
+  dev->base = num_swap_slots;
+  dev->slot_cnt = block_size (block) * BLOCK_SECTOR_SIZE / PGSIZE;
+  dev->prio = prio;
+  swap_dev_cnt++;
+  num_swap_slots += dev->slot_cnt;
+  printf ("swap: using %s, %zu slots, priority %d\n",
+          block_name (block), dev->slot_cnt, prio);
+}
 
-  struct frame_entry* frame_ptr;
-  int found = 0;
-  // iterate through the frame table until we find a frame to evict
-  while (found != 1)
+/* Returns the device that holds SLOT, and sets *SECTOR to the first
+   sector of SLOT on it. */
+static struct swap_dev*
+slot_dev (size_t slot, block_sector_t* sector)
+{
+  int i;
+
+  for (i = 0; i < swap_dev_cnt; i++)
   {
-    lock_acquire (&frame_lock);
-    frame_ptr = frame_table[current_clock];
+    struct swap_dev* dev = &swap_devs[i];
+    if (slot >= dev->base && slot < dev->base + dev->slot_cnt)
+    {
+      *sector = (slot - dev->base) * (PGSIZE / BLOCK_SECTOR_SIZE);
+      return dev;
+    }
+  }
+  PANIC ("swap: slot %zu is on no device", slot);
+}
+
+/* Finds CNT free slots in a row on one device, and returns the first,
+   or BITMAP_ERROR if there are none. Tries the devices in order of
+   priority, and among devices of equal priority starts with a
+   different one each time. swap_lock must be held. */
+static size_t
+scan_devs (size_t cnt)
+{
+  int first, end, i;
 
-    if (frame_ptr != NULL && frame_ptr->spte != NULL && frame_ptr->pinned == false)
+  for (first = 0; first < swap_dev_cnt; first = end)
+  {
+    for (end = first + 1; end < swap_dev_cnt
+         && swap_devs[end].prio == swap_devs[first].prio; end++)
+      continue;
+    for (i = 0; i < end - first; i++)
     {
-      // if the frame hasn't been accessed recently, we have found a candidate for eviction
-      if (!pagedir_is_accessed(frame_ptr->t->pagedir, frame_ptr->va_ptr) || !pagedir_is_accessed(frame_ptr->t->pagedir, frame_ptr->spte->addr))
+      struct swap_dev* dev = &swap_devs[first + (stripe + i) % (end - first)];
+      size_t slot = bitmap_scan (swap_slots, dev->base, cnt, false);
+      if (slot != BITMAP_ERROR && slot + cnt <= dev->base + dev->slot_cnt)
       {
-        found = 1;
-      }
-      // otherwise, update the accessed bits and move the clock
-      else
-      {
-        pagedir_set_accessed(frame_ptr->t->pagedir, frame_ptr->va_ptr, false);
-        pagedir_set_accessed(frame_ptr->t->pagedir, frame_ptr->spte->addr, false);
-        //current_clock = (current_clock+1) % (user_pgs-1);
+        stripe++;
+        return slot;
       }
     }
-    current_clock = (current_clock+1) % (user_pgs-1);
-    lock_release (&frame_lock);
   }
-  void* va_ptr = frame_ptr->va_ptr;
+  return BITMAP_ERROR;
+}
 
-  // clear the page here to prevent the owning process from editing this frame anymore
-  bool dirty = pagedir_is_dirty(frame_ptr->t->pagedir, frame_ptr->va_ptr) || pagedir_is_dirty(frame_ptr->t->pagedir, frame_ptr->spte->addr);
-  pagedir_clear_page (frame_ptr->t->pagedir, frame_ptr->spte->addr);
+/* Wakes the page cleaner if the free frames have fallen below the low
+   watermark. Called after every allocation, and before every eviction
+   on the fault path. */
+void
+swap_check_watermark (void)
+{
+  enum intr_level old_level;
+  bool wake;
 
-  // if the frame is dirty we have to write it to swap
-  if (dirty && frame_ptr->spte->writable)
+  if (high_watermark == 0)
+    return;
+  old_level = intr_disable ();
+  wake = !cleaner_awake && frame_free_cnt () < low_watermark;
+  if (wake)
+    cleaner_awake = true;
+  intr_set_level (old_level);
+  if (wake)
+    sema_up (&cleaner_sema);
+}
+
+/* Body of the page cleaner thread. Evicted frames go back on the frame
+   table's free list, where allocate_page() picks them up without any
+   extra bookkeeping. */
+static void
+page_cleaner (void *aux UNUSED)
+{
+  for (;;)
   {
-    // find an empty swap slot (8 blocks, 1 bit in the bitmap)
-    size_t open_slot = bitmap_scan_and_flip (swap_slots, 0, 1, 0);
+    enum intr_level old_level;
+    size_t free_cnt;
 
-    // now use that to write the page to disk (we need to write 8 sectors because there are 8 sectors in 1 page)
-    int i;
-    for (i = 0; i < 8; i++)
+    sema_down (&cleaner_sema);
+    while ((free_cnt = frame_free_cnt ()) < high_watermark)
     {
-      block_write (swap_block, open_slot * 8 + i, va_ptr + i * 512);
+      size_t batch = high_watermark - free_cnt;
+      if (batch > CLEANER_BATCH)
+        batch = CLEANER_BATCH;
+      // nothing evictable right now, e.g. every frame is pinned:
+      // back off and try again rather than leave the faulting
+      // threads to evict on their own
+      if (clean_batch (batch) == 0)
+        timer_sleep (CLEANER_BACKOFF);
+      // let faulting threads grab the frames we just freed
+      thread_yield ();
     }
+    old_level = intr_disable ();
+    cleaner_awake = false;
+    intr_set_level (old_level);
+  }
+}
 
-    // create a swap table entry for this to save that it was swapped
-    struct swap_table_elem* s = malloc(sizeof(struct swap_table_elem));
-    s->swap_location = open_slot;
-    lock_acquire (&frame_lock);
-    frame_ptr->spte->swap_elem = s;
-    list_push_back(&frame_ptr->t->swap_table, &s->elem);
-    frame_ptr->spte->swapped = true;
-    lock_release (&frame_lock);
+/* Evicts up to CNT pages for the page cleaner and frees their frames:
+   a victim chosen by the policy, then more pages of the same process.
+   Their slots come one after another from that process's cluster, so
+   the batch goes to the disk as one sequential run. Returns the number
+   of pages evicted. */
+static size_t
+clean_batch (size_t cnt)
+{
+  struct frame_entry* frame = evict_pick (false);
+  size_t n = 0;
+
+  while (frame != NULL)
+  {
+    // only compared by evict_pick_of(), so it's fine if it exits
+    struct thread* owner = frame->spte != NULL ? frame->t : NULL;
+
+    palloc_free_page (evict (frame));
+    if (++n == cnt || owner == NULL)
+      break;
+    frame = evict_pick_of (owner);
   }
+  return n;
+}
 
-  // set the contents of the page to 0 so that the next thread that
-  // obtains this page doesn't accidentally read old data that belonged
-  // to the previous thread that held the page
-  memset (va_ptr, 0, PGSIZE);
+/* Hands the unused rest of T's swap cluster back. swap_lock must be
+   held. */
+static void
+release_cluster (struct thread* t)
+{
+  if (t->swap_cluster < t->swap_cluster_end)
+    bitmap_set_multiple (swap_slots, t->swap_cluster,
+                         t->swap_cluster_end - t->swap_cluster, false);
+  t->swap_cluster = t->swap_cluster_end = 0;
+}
 
-  // free the resources in this page and the frame pointer so that we can put something else here
-  lock_acquire(&frame_lock);
-  free (frame_ptr);
-  lock_release(&frame_lock);
+/* thread_foreach() helper for scan_or_reclaim(). */
+static void
+release_cluster_of (struct thread* t, void* aux UNUSED)
+{
+  release_cluster (t);
+}
+
+/* Finds a free slot like scan_devs (1), but when there is none, takes
+   back the unused parts of every process's cluster before giving up.
+   swap_lock must be held. */
+static size_t
+scan_or_reclaim (void)
+{
+  enum intr_level old_level;
+  size_t slot = scan_devs (1);
+
+  if (slot != BITMAP_ERROR)
+    return slot;
+  old_level = intr_disable ();
+  thread_foreach (release_cluster_of, NULL);
+  intr_set_level (old_level);
+  slot = scan_devs (1);
+  if (slot == BITMAP_ERROR)
+    PANIC ("swap_out: out of swap slots");
+  return slot;
+}
+
+/* Takes a free slot for SPTE, the next one in its owner's current
+   cluster, so that a process's pages land next to each other on the
+   disk in the order they were evicted. A cluster's slots are all
+   marked in swap_slots as soon as it is started, so that other
+   processes' clusters don't interleave with it. A null SPTE takes any
+   free slot, owned by no one. */
+static size_t
+alloc_slot (struct page_table_elem* spte)
+{
+  struct thread* owner = spte != NULL ? spte->t : NULL;
+  size_t slot;
+
+  lock_acquire (&swap_lock);
+  if (owner == NULL)
+  {
+    slot = scan_or_reclaim ();
+    bitmap_mark (swap_slots, slot);
+  }
+  else if (owner->swap_cluster < owner->swap_cluster_end)
+    slot = owner->swap_cluster;
+  else
+  {
+    // start a new cluster in the first free run that is long enough,
+    // or settle for any free slot. a cluster never spans two devices
+    release_cluster (owner);
+    slot = scan_devs (SWAP_CLUSTER);
+    if (slot != BITMAP_ERROR)
+      owner->swap_cluster_end = slot + SWAP_CLUSTER;
+    else
+    {
+      slot = scan_or_reclaim ();
+      owner->swap_cluster_end = slot + 1;
+    }
+    bitmap_set_multiple (swap_slots, slot, owner->swap_cluster_end - slot, true);
+  }
+  slot_owner[slot] = spte;
+  if (owner != NULL)
+    owner->swap_cluster = slot + 1;
   lock_release (&swap_lock);
-  return va_ptr;
+  return slot;
 }
 
-void swap_in (uint8_t* kpage, struct page_table_elem* spte)
+/* Gives back the unused part of the current process's swap cluster.
+   Called when it exits. */
+void
+swap_release_cluster (void)
 {
   lock_acquire (&swap_lock);
-  struct thread* cur = thread_current();
+  release_cluster (thread_current ());
+  lock_release (&swap_lock);
+}
 
-  int swap_loc = spte->swap_elem->swap_location;
+/* Writes KPAGE to SLOT on the swap disk, bypassing the compressed
+   pool. */
+void
+swap_write_disk (size_t slot, const void* kpage)
+{
+  block_sector_t sector;
+  struct swap_dev* dev = slot_dev (slot, &sector);
+  int i;
 
-  // read the data in the swap slot into the new page
+  // 8 sectors make up a page
+  for (i = 0; i < 8; i++)
+    block_write (dev->block, sector + i, (const uint8_t*) kpage + i * 512);
+  vmstat_add (swap_outs, 1);
+}
+
+/* Writes KPAGE to SLOT: into the compressed pool if it compresses
+   and there is room, otherwise to the disk. */
+static void
+write_slot (size_t slot, const void* kpage)
+{
+  if (zswap_store (slot, kpage))
+    vmstat_add (zswap_stores, 1);
+  else
+    swap_write_disk (slot, kpage);
+}
+
+/* Writes KPAGE to a new slot that belongs to no process and returns
+   the slot. Used for pages shared copy-on-write, whose copy on disk
+   belongs to the shared page rather than to any one SPTE. */
+size_t
+swap_write_page (const void* kpage)
+{
+  size_t slot = alloc_slot (NULL);
+  write_slot (slot, kpage);
+  return slot;
+}
+
+/* Reads SLOT, which the caller keeps allocated, into KPAGE. */
+void
+swap_read_page (size_t slot, void* kpage)
+{
+  block_sector_t sector;
+  struct swap_dev* dev;
   int i;
+
+  if (zswap_load (slot, kpage))
+  {
+    vmstat_add (zswap_loads, 1);
+    return;
+  }
+  dev = slot_dev (slot, &sector);
   for (i = 0; i < 8; i++)
+    block_read (dev->block, sector + i, (uint8_t*) kpage + i * 512);
+  vmstat_add (swap_ins, 1);
+}
+
+/* Records SPTE, which may be NULL, as the page stored in SLOT. */
+void
+swap_set_owner (size_t slot, struct page_table_elem* spte)
+{
+  lock_acquire (&swap_lock);
+  slot_owner[slot] = spte;
+  lock_release (&swap_lock);
+}
+
+/* Frees SLOT. Called when its owner exits. */
+void
+swap_free_slot (size_t slot)
+{
+  zswap_invalidate (slot);
+  lock_acquire (&swap_lock);
+  bitmap_reset (swap_slots, slot);
+  slot_owner[slot] = NULL;
+  lock_release (&swap_lock);
+}
+
+/* Returns the SPT entry of thread T whose page is in SLOT, or NULL if
+   SLOT is out of range, free, or belongs to another thread. Holding
+   swap_lock while checking keeps another process's entries from being
+   freed under us. */
+struct page_table_elem*
+swap_slot_owner (int slot, struct thread* t)
+{
+  struct page_table_elem* spte = NULL;
+
+  if (slot < 0 || slot >= num_swap_slots)
+    return NULL;
+  lock_acquire (&swap_lock);
+  if (slot_owner[slot] != NULL && slot_owner[slot]->t == t)
+    spte = slot_owner[slot];
+  lock_release (&swap_lock);
+  return spte;
+}
+
+/* Evicts VICTIM, which evict_pick() returned locked and pinned,
+   writing it to swap if necessary. Returns a pointer to the frame,
+   which still holds the old page. The frame is returned pinned and owned by the
+   current thread, like a frame from allocate_page().
+
+   Only the victim's frame lock is held during the disk write, so faults
+   on other frames (and other evictions) proceed in parallel. */
+static void*
+evict (struct frame_entry* frame_ptr)
+{
+  struct page_table_elem* spte = frame_ptr->spte;
+  struct thread* owner = frame_ptr->t;
+  void* va_ptr = frame_ptr->va_ptr;
+
+  // shared text is clean and has no single owner: unmap it from every
+  // process that uses it, and the next fault rereads it
+  if (frame_ptr->share != NULL)
   {
-    block_read (swap_block, (swap_loc * 8) + i, kpage + (512 * i));
+    share_evict (frame_ptr);
+    goto done;
   }
 
-  // set the bitmap slot that corresponds to this swap slot to 0
-  // so that we can put something else in it
-  bitmap_set (swap_slots, swap_loc, 0);
+  // clear the page here to prevent the owning process from editing this
+  // frame anymore. only then read the dirty bit, which the PTE keeps: the
+  // owner may be running, and a write between the two would be lost
+  pagedir_clear_page (owner->pagedir, spte->addr);
+  bool dirty = evict_is_dirty (frame_ptr);
 
-  // now that this page has been swapped back in, set the swapped variable
-  // with this SPTE back to false
-  spte->swapped = false;
+  // if the frame is dirty we have to write it to swap. a clean page that
+  // still has its swap cache slot is already on disk, so all it takes is
+  // marking it swapped again
+  if (!dirty && spte->swap_elem != NULL)
+    spte->swapped = true;
+  else if (dirty)
+  {
+    // overwrite the page's old slot if it has one, otherwise
+    // find an empty swap slot (8 blocks, 1 bit in the bitmap)
+    struct swap_table_elem* s = spte->swap_elem;
+    size_t open_slot;
+    if (s != NULL)
+      open_slot = s->swap_location;
+    else
+      open_slot = alloc_slot (spte);
+
+    // now use that to write the page to disk
+    write_slot (open_slot, va_ptr);
+
+    // create a swap table entry for this to save that it was swapped
+    if (s == NULL)
+    {
+      s = malloc(sizeof(struct swap_table_elem));
+      s->swap_location = open_slot;
+      spte->swap_elem = s;
+      lock_acquire (&owner->spt_lock);
+      list_push_back(&owner->swap_table, &s->elem);
+      lock_release (&owner->spt_lock);
+    }
+    spte->swapped = true;
+  }
+  if (!dirty)
+    vmstat_add (discards, 1);
 
-  // set the entry in the frame table to correspond to this supplemental page table entry
-  uintptr_t phys_ptr = vtop (kpage);
-  uintptr_t pfn = pg_no (phys_ptr);
-  lock_acquire (&frame_lock);
-  frame_table[pfn-625]->spte = spte;
-  lock_release (&frame_lock);
+  // the page is no longer resident; a fault on it will wait for our
+  // frame lock and then find it on disk
+  spte->frame_ptr = NULL;
+  frame_ptr->spte = NULL;
 
-  // remove this swap element
-  list_remove (&spte->swap_elem->elem);
-  free (spte->swap_elem);
+ done:
+  frame_ptr->t = thread_current ();
 
-  lock_release (&swap_lock);
+  // the old contents stay until the new owner overwrites them:
+  // allocate_page() zeroes the frame if asked to, and every other
+  // caller fills all of it before mapping it
+  lock_release (&frame_ptr->lock);
+  return va_ptr;
 }
+
+/* Finds a frame to evict and swaps it out, writing the contents of the
+   frame to swap space if necessary. Returns a pointer
+   to it so that a process can use it. Waits for a frame to become
+   evictable if all of them are pinned. */
+void* swap_out ()
+{
+  int64_t start = timer_ticks ();
+  void* kpage = evict (evict_pick (true));
+
+  vmstat_add (swap_out_ticks, timer_elapsed (start));
+  return kpage;
+}
+
+/* Like swap_out(), but only evicts one of the current thread's own
+   pages, and returns NULL if none of them can be evicted right now. */
+void* swap_out_own (void)
+{
+  struct frame_entry* frame_ptr = evict_pick_of (thread_current ());
+  return frame_ptr != NULL ? evict (frame_ptr) : NULL;
+}
+
+/* Reads the page described by SPTE back from swap into KPAGE.
+
+   The slot is not released: it stays attached to SPTE as a swap cache
+   copy, so that if the page is evicted again before it is modified the
+   eviction needs no disk write. The slot is reused when the page is
+   next written back, and freed when the process exits. */
+void swap_in (uint8_t* kpage, struct page_table_elem* spte)
+{
+  // read the data in the swap slot into the new page
+  swap_read_page (spte->swap_elem->swap_location, kpage);
+
+  // now that this page has been swapped back in, set the swapped variable
+  // with this SPTE back to false
+  spte->swapped = false;
+}
+
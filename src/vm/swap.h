@@ -14,22 +14,32 @@
 #include "threads/palloc.h"
 #include "vm/page.h"
 
+#define SWAP_CLUSTER 16   // slots reserved together for one process's evictions
+#define SWAP_READAHEAD 4  // neighbouring slots read in on each side of a swap fault
+
 struct swap_table_elem
   {
     struct list_elem elem;
     int swap_location;
   };
 
-struct block* swap_block;
-int num_swap_slots;
+int num_swap_slots; // total over all swap devices
 
-struct lock swap_lock;
+struct lock swap_lock; // protects swap_slots only; never held across disk I/O
 
 struct bitmap* swap_slots;
 
-int current_clock;
-void swap_init (void);
+void swap_init (char* devices, size_t low, size_t high, size_t zswap_pages);
+void swap_check_watermark (void);
 void* swap_out (void);
+void* swap_out_own (void);
 void swap_in (uint8_t* addr, struct page_table_elem* spte);
+void swap_free_slot (size_t slot);
+void swap_release_cluster (void);
+size_t swap_write_page (const void* kpage);
+void swap_write_disk (size_t slot, const void* kpage);
+void swap_read_page (size_t slot, void* kpage);
+void swap_set_owner (size_t slot, struct page_table_elem* spte);
+struct page_table_elem* swap_slot_owner (int slot, struct thread* t);
 
 #endif // SWAP_H
@@ -0,0 +1,35 @@
+#include "vm/vmstat.h"
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Adds N to the counter at byte offset OFS in struct vmstat, in the
+   current thread's counters and in vmstat_global. Interrupts are
+   turned off so that a preempted update of a 64-bit counter can't
+   lose another thread's. */
+void
+vmstat_add_ofs (size_t ofs, long long n)
+{
+  enum intr_level old_level = intr_disable ();
+  *(long long*) ((char*) &vmstat_global + ofs) += n;
+  *(long long*) ((char*) &thread_current ()->vmstat + ofs) += n;
+  intr_set_level (old_level);
+}
+
+/* Prints the system-wide counters. */
+void
+vmstat_print_stats (void)
+{
+  struct vmstat* s = &vmstat_global;
+
+  printf ("VM: %lld minor faults, %lld major faults, %lld stack faults, "
+          "%lld prefetches\n",
+          s->minor_faults, s->major_faults, s->stack_faults, s->prefetches);
+  printf ("Swap: %lld swap-ins, %lld swap-outs, %lld clean discards, "
+          "%lld clock turns, %lld ticks evicting\n",
+          s->swap_ins, s->swap_outs, s->discards, s->clock_turns,
+          s->swap_out_ticks);
+  printf ("Zswap: %lld loads, %lld stores\n",
+          s->zswap_loads, s->zswap_stores);
+  printf ("KSM: %lld merge events\n", s->ksm_merge_events);
+}
@@ -0,0 +1,16 @@
+#ifndef VMSTAT_H
+#define VMSTAT_H
+
+#include <stddef.h>
+#include <vmstat.h>
+
+/* Adds N to counter FIELD of struct vmstat, for the current thread and
+   for the whole system. */
+#define vmstat_add(FIELD, N) vmstat_add_ofs (offsetof (struct vmstat, FIELD), N)
+
+struct vmstat vmstat_global;
+
+void vmstat_add_ofs (size_t ofs, long long n);
+void vmstat_print_stats (void);
+
+#endif
@@ -0,0 +1,252 @@
+#include "vm/zswap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <list.h>
+#include <lz.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/swap.h"
+
+#define ZSWAP_CHUNK 64                  /* Pool allocation unit, in bytes. */
+#define ZSWAP_MAX_SIZE (PGSIZE / 2)     /* Largest compressed page kept. */
+
+/* A compressed page in the pool. */
+struct zentry
+  {
+    struct list_elem elem;  // element in lru
+    size_t slot;            // the swap slot whose contents this is
+    size_t chunk;           // first pool chunk holding the data
+    size_t size;            // compressed size, in bytes
+    bool delta;             // the page was delta coded as 32-bit words first
+    bool writeback;         // being written to the slot on disk
+  };
+
+static uint8_t* pool;           // the pool itself, in ZSWAP_CHUNK byte chunks
+static struct bitmap* chunks;   // which chunks are in use
+static struct zentry** entries; // the entry for each swap slot, or NULL
+static struct list lru;         // entries not being written back, oldest first
+
+// protects everything above, and the scratch buffers below
+static struct lock zswap_lock;
+static struct condition writeback_done;
+
+static uint16_t hash_table[LZ_HASH_SIZE];
+static uint8_t compress_buf[ZSWAP_MAX_SIZE];
+static uint32_t delta_buf[PGSIZE / sizeof (uint32_t)];
+
+// writebacks take turns with one bounce page; held across disk I/O,
+// and always taken before zswap_lock
+static struct lock writeback_lock;
+static void* writeback_page;
+
+static size_t chunk_cnt (size_t size);
+static size_t compress (const void* kpage, bool* delta);
+static void decompress (struct zentry* z, void* kpage);
+static void drop (size_t slot);
+static void write_back (struct zentry* z);
+
+/* Sets up a pool of PAGE_CNT kernel pages for compressed copies of
+   SLOT_CNT swap slots. A PAGE_CNT of 0 disables the pool. */
+void
+zswap_init (size_t slot_cnt, size_t page_cnt)
+{
+  lock_init (&zswap_lock);
+  cond_init (&writeback_done);
+  lock_init (&writeback_lock);
+  list_init (&lru);
+  if (page_cnt == 0)
+    return;
+
+  pool = palloc_get_multiple (0, page_cnt);
+  writeback_page = palloc_get_page (0);
+  chunks = bitmap_create (page_cnt * PGSIZE / ZSWAP_CHUNK);
+  entries = calloc (slot_cnt, sizeof *entries);
+  if (pool == NULL || writeback_page == NULL || chunks == NULL
+      || entries == NULL)
+    PANIC ("zswap_init: cannot allocate %zu pages of compressed swap",
+           page_cnt);
+  printf ("zswap: %zu kB compressed swap pool\n", page_cnt * PGSIZE / 1024);
+}
+
+/* Stores a compressed copy of KPAGE as the contents of SLOT. Returns
+   false if there is no pool, the page doesn't compress well enough, or
+   the pool is full and nothing in it can be written out, and then the
+   caller must write KPAGE to the disk itself. Either way, any older
+   copy of SLOT in the pool is gone. */
+bool
+zswap_store (size_t slot, const void* kpage)
+{
+  struct zentry* z;
+  size_t size, chunk;
+  bool delta;
+
+  if (pool == NULL)
+    return false;
+
+  lock_acquire (&zswap_lock);
+  for (;;)
+  {
+    drop (slot);
+    size = compress (kpage, &delta);
+    if (size == 0)
+    {
+      lock_release (&zswap_lock);
+      return false;
+    }
+    chunk = bitmap_scan_and_flip (chunks, 0, chunk_cnt (size), false);
+    if (chunk != BITMAP_ERROR)
+      break;
+
+    // full: write the coldest page out to its slot and try again
+    if (list_empty (&lru))
+    {
+      lock_release (&zswap_lock);
+      return false;
+    }
+    write_back (list_entry (list_front (&lru), struct zentry, elem));
+  }
+
+  z = malloc (sizeof *z);
+  if (z == NULL)
+  {
+    bitmap_set_multiple (chunks, chunk, chunk_cnt (size), false);
+    lock_release (&zswap_lock);
+    return false;
+  }
+  z->slot = slot;
+  z->chunk = chunk;
+  z->size = size;
+  z->delta = delta;
+  z->writeback = false;
+  memcpy (pool + chunk * ZSWAP_CHUNK, compress_buf, size);
+  entries[slot] = z;
+  list_push_back (&lru, &z->elem);
+  lock_release (&zswap_lock);
+  return true;
+}
+
+/* Reads SLOT into KPAGE if the pool has it, and returns true, or
+   returns false if the caller must read it from the disk. */
+bool
+zswap_load (size_t slot, void* kpage)
+{
+  struct zentry* z;
+
+  if (pool == NULL)
+    return false;
+
+  lock_acquire (&zswap_lock);
+  z = entries[slot];
+  if (z != NULL)
+    decompress (z, kpage);
+  lock_release (&zswap_lock);
+  return z != NULL;
+}
+
+/* Forgets the contents of SLOT, which is being freed. */
+void
+zswap_invalidate (size_t slot)
+{
+  if (pool == NULL)
+    return;
+
+  lock_acquire (&zswap_lock);
+  drop (slot);
+  lock_release (&zswap_lock);
+}
+
+/* Returns the number of pool chunks that SIZE bytes take. */
+static size_t
+chunk_cnt (size_t size)
+{
+  return DIV_ROUND_UP (size, ZSWAP_CHUNK);
+}
+
+/* Compresses KPAGE into compress_buf and returns its size, or returns
+   0 if it doesn't fit. Pages of slowly changing words, like sorted
+   arrays of integers, have few repeats but compress well as the
+   differences between neighbouring words, so those are tried too, in
+   which case *DELTA is set to true. zswap_lock must be held. */
+static size_t
+compress (const void* kpage, bool* delta)
+{
+  const uint32_t* words = kpage;
+  uint32_t prev = 0;
+  size_t i, size;
+
+  *delta = false;
+  size = lz_compress (kpage, PGSIZE, compress_buf, ZSWAP_MAX_SIZE, hash_table);
+  if (size != 0)
+    return size;
+
+  for (i = 0; i < PGSIZE / sizeof *words; i++)
+  {
+    delta_buf[i] = words[i] - prev;
+    prev = words[i];
+  }
+  *delta = true;
+  return lz_compress (delta_buf, PGSIZE, compress_buf, ZSWAP_MAX_SIZE,
+                      hash_table);
+}
+
+/* Decompresses Z into KPAGE. zswap_lock must be held. */
+static void
+decompress (struct zentry* z, void* kpage)
+{
+  uint32_t* words = kpage;
+  size_t i;
+
+  if (!lz_decompress (pool + z->chunk * ZSWAP_CHUNK, z->size, kpage, PGSIZE))
+    PANIC ("zswap: slot %zu is corrupt", z->slot);
+  if (z->delta)
+    for (i = 1; i < PGSIZE / sizeof *words; i++)
+      words[i] += words[i - 1];
+}
+
+/* Frees SLOT's entry, if it has one, after waiting for any writeback
+   of it to finish: a new disk write to the slot must not race with an
+   old one. zswap_lock must be held. */
+static void
+drop (size_t slot)
+{
+  struct zentry* z;
+
+  while ((z = entries[slot]) != NULL && z->writeback)
+    cond_wait (&writeback_done, &zswap_lock);
+  if (z == NULL)
+    return;
+  list_remove (&z->elem);
+  bitmap_set_multiple (chunks, z->chunk, chunk_cnt (z->size), false);
+  entries[slot] = NULL;
+  free (z);
+}
+
+/* Writes Z to its slot on disk and frees it. zswap_lock must be held;
+   it is released during the write. Loads of Z's slot keep being served
+   from the pool until the disk copy is complete. */
+static void
+write_back (struct zentry* z)
+{
+  list_remove (&z->elem);
+  z->writeback = true;
+  lock_release (&zswap_lock);
+
+  lock_acquire (&writeback_lock);
+  lock_acquire (&zswap_lock);
+  decompress (z, writeback_page);
+  lock_release (&zswap_lock);
+  swap_write_disk (z->slot, writeback_page);
+  lock_release (&writeback_lock);
+
+  lock_acquire (&zswap_lock);
+  bitmap_set_multiple (chunks, z->chunk, chunk_cnt (z->size), false);
+  entries[z->slot] = NULL;
+  free (z);
+  cond_broadcast (&writeback_done, &zswap_lock);
+}
@@ -0,0 +1,21 @@
+#ifndef ZSWAP_H
+#define ZSWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Compressed swap cache. Pages written to a swap slot are compressed
+   into a pool of kernel memory instead of going to the swap disk, and
+   faults on them decompress them from there. A page that doesn't
+   compress to half its size goes straight to disk, and when the pool
+   fills up the pages that have been in it longest are written out to
+   their slots to make room. The pool only ever holds the current
+   contents of a slot: a slot's disk copy is stale while it is in the
+   pool. */
+
+void zswap_init (size_t slot_cnt, size_t page_cnt);
+bool zswap_store (size_t slot, const void* kpage);
+bool zswap_load (size_t slot, void* kpage);
+void zswap_invalidate (size_t slot);
+
+#endif